@@ -0,0 +1,117 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lineindex.h"
+#include "terminal.h"
+
+
+// 行索引吞吐量基准：对同一个文件分别用旧的 getline 逐行读取（含去掉行尾 \n、\r）
+// 和 lineIndexScan 批量建立索引，各跑若干轮取最快一轮，输出 GB/s。
+// 用法：lineindex_bench [文件]。不给文件时生成约 256 MB 的合成日志。
+#define BENCH_ROUNDS 5
+#define BENCH_LOG_SIZE (256 << 20)
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 写一份行长 20 到 200 字节不等的合成日志，返回其文件描述符。
+static int makeLog(char *path) {
+  int fd = mkstemp(path);
+  if (fd == -1) die("mkstemp");
+  FILE *fp = fdopen(fd, "w");
+  if (fp == NULL) die("fdopen");
+  unsigned int seed = 1;
+  long written = 0;
+  for (long i = 0; written < BENCH_LOG_SIZE; i++) {
+    seed = seed * 1103515245 + 12345;
+    int pad = (seed >> 16) % 120;
+    written += fprintf(fp, "2026-10-16T10:%02ld:%02ld.%03ld INFO worker-%ld request id=%ld latency=%ldms %.*s\n",
+                       i / 60000 % 60, i / 1000 % 60, i % 1000, i % 16, i, i % 997, pad,
+                       "................................................................................"
+                       "........................................");
+  }
+  if (fflush(fp) != 0) die("fflush");
+  int copy = dup(fd);
+  fclose(fp);
+  return copy;
+}
+
+// 旧的读取路径：逐行 getline 并去掉行尾的 \n、\r。
+static size_t scanGetline(int fd) {
+  if (lseek(fd, 0, SEEK_SET) == -1) die("lseek");
+  FILE *fp = fdopen(dup(fd), "r");
+  if (fp == NULL) die("fdopen");
+  char *line = NULL;
+  size_t linecap = 0;
+  ssize_t linelen;
+  size_t lines = 0;
+  while ((linelen = getline(&line, &linecap, fp)) != -1) {
+    while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+      linelen--;
+    lines++;
+  }
+  free(line);
+  fclose(fp);
+  return lines;
+}
+
+static size_t scanIndex(const char *map, size_t size) {
+  struct lineIndex index;
+  lineIndexInit(&index);
+  lineIndexScan(&index, map, size, 0);
+  size_t lines = index.count;
+  lineIndexFree(&index);
+  return lines;
+}
+
+int main(int argc, char *argv[]) {
+  char path[] = "/tmp/lineindex_bench.XXXXXX";
+  int fd;
+  if (argc > 1) {
+    fd = open(argv[1], O_RDONLY);
+    if (fd == -1) die("open");
+  } else {
+    fd = makeLog(path);
+    unlink(path);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) die("fstat");
+  size_t size = st.st_size;
+  char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) die("mmap");
+
+  // 先各跑一遍预热页缓存，并确认两条路径数出的行数一致。
+  size_t a = scanGetline(fd);
+  size_t b = scanIndex(map, size);
+  printf("%zu bytes, getline %zu lines, index %zu newlines\n", size, a, b);
+
+  double best_getline = 1e30, best_index = 1e30;
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    double t = now();
+    scanGetline(fd);
+    t = now() - t;
+    if (t < best_getline) best_getline = t;
+
+    t = now();
+    scanIndex(map, size);
+    t = now() - t;
+    if (t < best_index) best_index = t;
+  }
+  printf("getline + trim   %6.2f GB/s\n", size / best_getline / 1e9);
+  printf("lineIndexScan    %6.2f GB/s\n", size / best_index / 1e9);
+
+  munmap(map, size);
+  close(fd);
+  return 0;
+}
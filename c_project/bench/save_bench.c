@@ -0,0 +1,145 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "lineindex.h"
+#include "save.h"
+#include "terminal.h"
+
+
+// 保存吞吐量基准：把文件映射成行（与编辑器打开文件时相同），
+// 分别用旧的整块拼接后原地覆写和 saveFile 的流式写出保存到临时文件，
+// 各跑若干轮取最快一轮，输出 MB/s。
+// 用法：save_bench [文件]。不给文件时生成约 256 MB 的合成日志。
+#define BENCH_ROUNDS 3
+#define BENCH_LOG_SIZE (256 << 20)
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 写一份行长 20 到 200 字节不等的合成日志，返回其文件描述符。
+static int makeLog(char *path) {
+  int fd = mkstemp(path);
+  if (fd == -1) die("mkstemp");
+  FILE *fp = fdopen(fd, "w");
+  if (fp == NULL) die("fdopen");
+  unsigned int seed = 1;
+  long written = 0;
+  for (long i = 0; written < BENCH_LOG_SIZE; i++) {
+    seed = seed * 1103515245 + 12345;
+    int pad = (seed >> 16) % 120;
+    written += fprintf(fp, "2026-10-16T10:%02ld:%02ld.%03ld INFO worker-%ld request id=%ld latency=%ldms %.*s\n",
+                       i / 60000 % 60, i / 1000 % 60, i % 1000, i % 16, i, i % 997, pad,
+                       "................................................................................"
+                       "........................................");
+  }
+  if (fflush(fp) != 0) die("fflush");
+  int copy = dup(fd);
+  fclose(fp);
+  return copy;
+}
+
+// 旧的保存路径：逐行查找并拼成一整块，再截断原文件、一次写入。
+static long long saveWhole(const struct rowBuffer *rows, const char *path) {
+  int count = bufferCount(rows);
+  long long total = 0;
+  for (int j = 0; j < count; j++)
+    total += bufferAt(rows, j)->size + 1;
+
+  char *buf = malloc(total);
+  if (buf == NULL) die("malloc");
+  char *p = buf;
+  for (int j = 0; j < count; j++) {
+    erow *row = bufferAt(rows, j);
+    const char *s;
+    int len;
+    for (int k = 0; (len = rowSpan(row, k, &s)) != -1; k++) {
+      memcpy(p, s, len);
+      p += len;
+    }
+    *p++ = '\n';
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd == -1) die("open");
+  if (ftruncate(fd, total) == -1) die("ftruncate");
+  if (write(fd, buf, total) != total) die("write");
+  close(fd);
+  free(buf);
+  return total;
+}
+
+int main(int argc, char *argv[]) {
+  char path[] = "/tmp/save_bench.XXXXXX";
+  int fd;
+  if (argc > 1) {
+    fd = open(argv[1], O_RDONLY);
+    if (fd == -1) die("open");
+  } else {
+    fd = makeLog(path);
+    unlink(path);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) die("fstat");
+  size_t size = st.st_size;
+  char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) die("mmap");
+
+  struct lineIndex index;
+  lineIndexInit(&index);
+  lineIndexScan(&index, map, size, 0);
+  struct rowBuffer rows;
+  bufferInit(&rows);
+  erow **added = malloc(sizeof(erow *) * index.count);
+  if (added == NULL) die("malloc");
+  bufferInsertRows(&rows, 0, index.count, added);
+  size_t start = 0;
+  for (size_t j = 0; j < index.count; j++) {
+    rowInitMapped(added[j], &map[start], index.newlines[j] - start);
+    start = index.newlines[j] + 1;
+  }
+  free(added);
+  printf("%zu bytes, %zu rows\n", size, index.count);
+
+  char out[] = "/tmp/save_bench.out.XXXXXX";
+  int out_fd = mkstemp(out);
+  if (out_fd == -1) die("mkstemp");
+  close(out_fd);
+
+  double best_whole = 1e30, best_stream = 1e30, best_sync = 1e30;
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    double t = now();
+    saveWhole(&rows, out);
+    t = now() - t;
+    if (t < best_whole) best_whole = t;
+
+    t = now();
+    if (saveFile(&rows, out, 0) == -1) die("saveFile");
+    t = now() - t;
+    if (t < best_stream) best_stream = t;
+
+    t = now();
+    if (saveFile(&rows, out, 1) == -1) die("saveFile");
+    t = now() - t;
+    if (t < best_sync) best_sync = t;
+  }
+  printf("whole buffer + write    %7.1f MB/s\n", size / best_whole / 1e6);
+  printf("saveFile                %7.1f MB/s\n", size / best_stream / 1e6);
+  printf("saveFile + fsync        %7.1f MB/s\n", size / best_sync / 1e6);
+
+  unlink(out);
+  munmap(map, size);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,84 @@
+#define _GNU_SOURCE
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "slab.h"
+#include "terminal.h"
+
+
+// 行存储内存报告：按几种平均行长分配一百万行的文本块，
+// 分别用逐块 malloc 和 slab 分配器，报告堆的增长量与全部释放所需的时间。
+// 每种情况在独立的子进程中运行，互不影响各自的堆。
+// 用法：slab_report [行数]。
+#define REPORT_ROWS 1000000
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t heapUsed() {
+  struct mallinfo2 info = mallinfo2();
+  return info.arena + info.hblkhd;
+}
+
+// 行长在 [1, 2 * average) 内均匀分布，块大小为行长加结尾的 '\0'。
+static void report(int rows, int average, int use_slab) {
+  char **blocks = malloc(sizeof(char *) * rows);
+  size_t *sizes = malloc(sizeof(size_t) * rows);
+  if (blocks == NULL || sizes == NULL) die("malloc");
+  unsigned int seed = average;
+
+  size_t before = heapUsed();
+  for (int j = 0; j < rows; j++) {
+    seed = seed * 1103515245 + 12345;
+    size_t len = 1 + (seed >> 16) % (2 * average - 1);
+    sizes[j] = use_slab ? slabSize(len + 1) : len + 1;
+    blocks[j] = use_slab ? slabAlloc(sizes[j]) : malloc(sizes[j]);
+    if (blocks[j] == NULL) die("malloc");
+    memset(blocks[j], 'x', len);
+    blocks[j][len] = '\0';
+  }
+  size_t grown = heapUsed() - before;
+
+  double t = now();
+  if (use_slab) {
+    for (int j = 0; j < rows; j++)
+      if (sizes[j] > SLAB_MAX_SIZE) slabFree(blocks[j], sizes[j]);
+    slabReleaseAll();
+  } else {
+    for (int j = 0; j < rows; j++)
+      free(blocks[j]);
+  }
+  t = now() - t;
+
+  printf("%4d bytes  %-6s %8.1f MB %8.2f ms\n", average, use_slab ? "slab" : "malloc",
+         grown / 1048576.0, t * 1000);
+  free(blocks);
+  free(sizes);
+}
+
+int main(int argc, char *argv[]) {
+  int rows = argc > 1 ? atoi(argv[1]) : REPORT_ROWS;
+  static const int averages[] = {6, 18, 45, 120};
+  printf("%d rows\navg length  alloc    heap growth  release all\n", rows);
+  fflush(stdout);
+  for (size_t k = 0; k < sizeof(averages) / sizeof(averages[0]); k++) {
+    for (int use_slab = 0; use_slab <= 1; use_slab++) {
+      pid_t pid = fork();
+      if (pid == -1) die("fork");
+      if (pid == 0) {
+        report(rows, averages[k], use_slab);
+        exit(0);
+      }
+      waitpid(pid, NULL, 0);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "slab.h"
+#include "terminal.h"
+
+
+struct rowNode {
+  erow row;
+  struct rowNode *left;
+  struct rowNode *right;
+  struct rowNode *parent; // 仅用于由行地址反查行号，根节点为 NULL。
+  int count;              // 子树中的行数，用作隐式键。
+  unsigned int priority;  // 堆优先级，随机生成以保持期望平衡。
+};
+
+static int nodeCount(const struct rowNode *n) {
+  return n ? n->count : 0;
+}
+
+static void nodeUpdate(struct rowNode *n) {
+  n->count = 1 + nodeCount(n->left) + nodeCount(n->right);
+  if (n->left) n->left->parent = n;
+  if (n->right) n->right->parent = n;
+}
+
+static void setRoot(struct rowBuffer *b, struct rowNode *root) {
+  b->root = root;
+  if (root) root->parent = NULL;
+}
+
+// 节点大小固定，由行存储的分级分配器统一分配。
+static struct rowNode *newNode(void) {
+  struct rowNode *node = slabAlloc(sizeof(struct rowNode));
+  memset(node, 0, sizeof(struct rowNode));
+  return node;
+}
+
+static unsigned int nextPriority(struct rowBuffer *b) {
+  // xorshift32，足以打散优先级。
+  unsigned int x = b->seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  b->seed = x;
+  return x;
+}
+
+// 将 t 拆分为前 k 行 (*l) 与其余行 (*r)。
+static void split(struct rowNode *t, int k, struct rowNode **l, struct rowNode **r) {
+  if (t == NULL) {
+    *l = *r = NULL;
+    return;
+  }
+  if (nodeCount(t->left) < k) {
+    split(t->right, k - nodeCount(t->left) - 1, &t->right, r);
+    *l = t;
+  } else {
+    split(t->left, k, l, &t->left);
+    *r = t;
+  }
+  nodeUpdate(t);
+}
+
+// 按顺序拼接 l 与 r，l 中所有行位于 r 之前。
+static struct rowNode *merge(struct rowNode *l, struct rowNode *r) {
+  if (l == NULL) return r;
+  if (r == NULL) return l;
+  if (l->priority > r->priority) {
+    l->right = merge(l->right, r);
+    nodeUpdate(l);
+    return l;
+  }
+  r->left = merge(l, r->left);
+  nodeUpdate(r);
+  return r;
+}
+
+void bufferInit(struct rowBuffer *b) {
+  b->root = NULL;
+  b->seed = 2463534242u;
+}
+
+int bufferCount(const struct rowBuffer *b) {
+  return nodeCount(b->root);
+}
+
+erow *bufferAt(const struct rowBuffer *b, int at) {
+  struct rowNode *n = b->root;
+  while (n) {
+    int left = nodeCount(n->left);
+    if (at < left) {
+      n = n->left;
+    } else if (at == left) {
+      return &n->row;
+    } else {
+      at -= left + 1;
+      n = n->right;
+    }
+  }
+  return NULL;
+}
+
+// 在第 at 行处插入一个清零的新行，返回其地址供调用者填充。
+erow *bufferInsert(struct rowBuffer *b, int at) {
+  struct rowNode *node = newNode();
+  node->count = 1;
+  node->priority = nextPriority(b);
+
+  struct rowNode *l, *r;
+  split(b->root, at, &l, &r);
+  setRoot(b, merge(merge(l, node), r));
+  return &node->row;
+}
+
+static void updateCounts(struct rowNode *n) {
+  if (n == NULL) return;
+  updateCounts(n->left);
+  updateCounts(n->right);
+  nodeUpdate(n);
+}
+
+// 在第 at 行处一次插入 count 个清零的新行，rows[i] 返回第 i 个新行的地址。
+// 先用栈在 O(count) 内把新节点建成一棵 treap，再整体并入，避免逐行拆分合并。
+void bufferInsertRows(struct rowBuffer *b, int at, int count, erow **rows) {
+  if (count <= 0) return;
+  struct rowNode **stack = malloc(sizeof(struct rowNode *) * count);
+  if (stack == NULL) die("malloc");
+  int depth = 0;
+
+  for (int i = 0; i < count; i++) {
+    struct rowNode *node = newNode();
+    node->priority = nextPriority(b);
+    rows[i] = &node->row;
+
+    // 维护右链上优先级递减：弹出优先级更低的节点作为新节点的左子树。
+    struct rowNode *last = NULL;
+    while (depth > 0 && stack[depth - 1]->priority < node->priority)
+      last = stack[--depth];
+    node->left = last;
+    if (depth > 0) stack[depth - 1]->right = node;
+    stack[depth++] = node;
+  }
+  struct rowNode *built = stack[0];
+  free(stack);
+  updateCounts(built);
+
+  struct rowNode *l, *r;
+  split(b->root, at, &l, &r);
+  setRoot(b, merge(merge(l, built), r));
+}
+
+// 从树中摘除第 at 行；行内容需由调用者先行释放。
+void bufferDelete(struct rowBuffer *b, int at) {
+  struct rowNode *l, *m, *r;
+  split(b->root, at, &l, &m);
+  split(m, 1, &m, &r);
+  slabFree(m, sizeof(struct rowNode));
+  setRoot(b, merge(l, r));
+}
+
+static void freeNodes(struct rowNode *n, void (*release)(erow *row)) {
+  if (n == NULL) return;
+  freeNodes(n->left, release);
+  freeNodes(n->right, release);
+  release(&n->row);
+  slabFree(n, sizeof(struct rowNode));
+}
+
+// 一次摘除从第 at 行起的 count 行，每行先交给 release 释放内容。
+// 只需两次拆分与一次合并，被摘下的子树整体释放。
+void bufferDeleteRows(struct rowBuffer *b, int at, int count, void (*release)(erow *row)) {
+  if (count <= 0) return;
+  struct rowNode *l, *m, *r;
+  split(b->root, at, &l, &m);
+  split(m, count, &m, &r);
+  freeNodes(m, release);
+  setRoot(b, merge(l, r));
+}
+
+// 返回 row 的行号，O(log n)。row 须是仍在树中的行。
+int bufferIndexOf(const struct rowBuffer *b, const erow *row) {
+  (void) b;
+  // row 是节点的第一个成员，其地址即节点地址。
+  const struct rowNode *n = (const struct rowNode *) row;
+  int at = nodeCount(n->left);
+  for (; n->parent; n = n->parent)
+    if (n == n->parent->right)
+      at += nodeCount(n->parent->left) + 1;
+  return at;
+}
+
+static int visitNode(struct rowNode *n, int (*visit)(erow *row, void *arg), void *arg) {
+  if (n == NULL) return 0;
+  if (visitNode(n->left, visit, arg)) return 1;
+  if (visit(&n->row, arg)) return 1;
+  return visitNode(n->right, visit, arg);
+}
+
+// 按行号顺序访问所有行，整体 O(n)；visit 返回非零时提前停止并返回 1。
+int bufferForEach(const struct rowBuffer *b, int (*visit)(erow *row, void *arg), void *arg) {
+  return visitNode(b->root, visit, arg);
+}
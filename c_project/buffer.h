@@ -0,0 +1,35 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include "row.h"
+
+
+struct rowNode;
+
+// 行存储引擎：以行号为隐式键的平衡树（treap），
+// 按行号查找、插入、删除均为 O(log n)，且 erow 的地址在其生命周期内保持不变。
+struct rowBuffer {
+  struct rowNode *root;
+  unsigned int seed;
+};
+
+void bufferInit(struct rowBuffer *b);
+
+int bufferCount(const struct rowBuffer *b);
+
+erow *bufferAt(const struct rowBuffer *b, int at);
+
+erow *bufferInsert(struct rowBuffer *b, int at);
+
+void bufferInsertRows(struct rowBuffer *b, int at, int count, erow **rows);
+
+void bufferDelete(struct rowBuffer *b, int at);
+
+void bufferDeleteRows(struct rowBuffer *b, int at, int count, void (*release)(erow *row));
+
+int bufferIndexOf(const struct rowBuffer *b, const erow *row);
+
+int bufferForEach(const struct rowBuffer *b, int (*visit)(erow *row, void *arg), void *arg);
+
+
+#endif //BUFFER_H
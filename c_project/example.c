@@ -4,24 +4,41 @@
 #define _BSD_SOURCE
 #define _GNU_SOURCE
 
+#include <assert.h>
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/select.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "slab.h"
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#define TEXOR_SEARCH_SSE2
+#endif
+
 /*** defines ***/
 
 #define TEXOR_VERSION "0.0.1"
 #define TEXOR_TAB_STOP 8
+#define TEXOR_COLUMN_MAP_MIN 256
 #define TEXOR_QUIT_TIMES 3
+#define TEXOR_SYNTAX_SYNC_ROWS 256
+#define TEXOR_SYNTAX_MIN_BATCH 64
+#define TEXOR_SYNTAX_MAX_BATCH 4096
+#define TEXOR_SYNTAX_INFLIGHT 2
+#define TEXOR_SEARCH_MEMCHR_RATIO 256
+#define TEXOR_SEARCH_COUNT_ROWS 16384
 
 #define CTRL_KEY(k) ((k) & 0x1f)
 
@@ -54,6 +71,14 @@ enum editorHighlight {
 
 /*** data ***/
 
+struct keywordTrie {
+  unsigned char classes[256];
+  int class_count;
+  int node_count;
+  unsigned short *next;
+  unsigned char *match;
+};
+
 struct editorSyntax {
   char *file_type;
   char **file_match;
@@ -62,16 +87,21 @@ struct editorSyntax {
   char *multiline_comment_start;
   char *multiline_comment_end;
   int flags;
+  struct keywordTrie *keyword_trie;
 };
 
 typedef struct erow {
   int index;
   int size;
+  int capacity;
   int rendered_size;
   char *characters;
   char *rendered_characters;
   unsigned char *highlight;
   int highlight_open_comment;
+  int highlight_start_comment;
+  int highlight_stale;
+  int highlight_dirty;
 } erow;
 
 struct editorConfig {
@@ -88,11 +118,61 @@ struct editorConfig {
   char status_message[80];
   time_t status_message_time;
   struct editorSyntax *syntax;
+  int syntax_valid_rows;
+  int syntax_invalid_end;
+  unsigned int syntax_version;
   struct termios orig_termios;
 };
 
 struct editorConfig E;
 
+struct syntaxJobRow {
+  int offset;
+  int size;
+  int start_comment;
+  int open_comment;
+  int outdated;
+  unsigned char *highlight;
+};
+
+struct syntaxJob {
+  struct syntaxJob *next;
+  unsigned int version;
+  struct editorSyntax *syntax;
+  int first;
+  int count;
+  int start_comment;
+  char *text;
+  unsigned char *highlight;
+  struct syntaxJobRow *rows;
+};
+
+struct syntaxWorker {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int started;
+  unsigned int version;
+  struct syntaxJob *todo, *todo_tail;
+  struct syntaxJob *done, *done_tail;
+  int notify[2];
+  int inflight;
+  unsigned int posted_version;
+  int next_row;
+  int chained;
+  int batch;
+};
+
+struct syntaxWorker SW;
+
+struct colorEscape {
+  int color;
+  int length;
+  char sequence[8];
+};
+
+struct colorEscape COLORS[256];
+
 /*** filetypes ***/
 
 char *C_HL_extensions[] = { ".c", ".h", ".cpp", NULL };
@@ -119,14 +199,16 @@ struct editorSyntax HLDB[] = {
     C_HL_extensions,
     C_HL_keywords,
     "//", "/*", "*/",
-    HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS
+    HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS,
+    NULL
   },
   {
     "ruby",
     RUBY_HL_extensions,
     RUBY_HL_keywords,
     "#", "=begin", "=end",
-    HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS
+    HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS,
+    NULL
   },
 };
 
@@ -136,7 +218,11 @@ struct editorSyntax HLDB[] = {
 
 void editorSetStatusMessage(const char *fmt, ...);
 void editorRefreshScreen();
+void editorWaitForInput();
 char *editorPrompt(char *prompt, void (*callback)(char *, int));
+char *editorRowRendered(erow *row);
+int searchCounterIdle();
+void editorFindCallback(char *query, int key);
 
 /*** terminal ***/
 
@@ -170,6 +256,7 @@ void enableRawMode() {
 int editorReadKey() {
   int nread;
   char c;
+  editorWaitForInput();
   while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
     if (nread == -1 && errno != EAGAIN) die("read");
   }
@@ -255,17 +342,67 @@ int is_separator(int c) {
   return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
 }
 
-void editorUpdateSyntax(erow *row) {
-  row->highlight = realloc(row->highlight, row->rendered_size);
-  memset(row->highlight, HL_NORMAL, row->rendered_size);
+void editorBuildKeywordTrie(struct editorSyntax *syntax) {
+  struct keywordTrie *trie = calloc(1, sizeof(struct keywordTrie));
+  char **keywords = syntax->keywords;
+
+  int max_nodes = 1;
+  for (int j = 0; keywords[j]; j++) {
+    int klen = strlen(keywords[j]);
+    if (keywords[j][klen - 1] == '|') klen--;
+    max_nodes += klen;
+    for (int k = 0; k < klen; k++) {
+      unsigned char c = keywords[j][k];
+      if (!trie->classes[c]) trie->classes[c] = ++trie->class_count;
+    }
+  }
 
-  if (E.syntax == NULL) return;
+  int stride = trie->class_count + 1;
+  trie->next = calloc(max_nodes * stride, sizeof(unsigned short));
+  trie->match = calloc(max_nodes, 1);
+  trie->node_count = 1;
+
+  for (int j = 0; keywords[j]; j++) {
+    int klen = strlen(keywords[j]);
+    int kw2 = keywords[j][klen - 1] == '|';
+    if (kw2) klen--;
+
+    int node = 0;
+    for (int k = 0; k < klen; k++) {
+      unsigned short *child = &trie->next[node * stride + trie->classes[(unsigned char) keywords[j][k]]];
+      if (!*child) *child = trie->node_count++;
+      node = *child;
+    }
+    if (trie->match[node] == HL_NORMAL) trie->match[node] = kw2 ? HL_KEYWORD2 : HL_KEYWORD1;
+  }
 
-  char **keywords = E.syntax->keywords;
+  syntax->keyword_trie = trie;
+}
 
-  char *singleline_comment_start = E.syntax->singleline_comment_start;
-  char *multiline_comment_start = E.syntax->multiline_comment_start;
-  char *multiline_comment_end = E.syntax->multiline_comment_end;
+int editorMatchKeyword(const struct keywordTrie *trie, const char *s, unsigned char *type) {
+  int stride = trie->class_count + 1;
+  int node = 0;
+  for (int k = 0; ; k++) {
+    if (trie->match[node] != HL_NORMAL && is_separator(s[k])) {
+      *type = trie->match[node];
+      return k;
+    }
+    int c = trie->classes[(unsigned char) s[k]];
+    if (!c) return 0;
+    node = trie->next[node * stride + c];
+    if (!node) return 0;
+  }
+}
+
+int editorHighlightText(struct editorSyntax *syntax, const char *text, int size, int in_comment,
+                        unsigned char *highlight) {
+  memset(highlight, HL_NORMAL, size);
+
+  if (syntax == NULL) return 0;
+
+  char *singleline_comment_start = syntax->singleline_comment_start;
+  char *multiline_comment_start = syntax->multiline_comment_start;
+  char *multiline_comment_end = syntax->multiline_comment_end;
 
   int singleline_comment_start_length = singleline_comment_start ? strlen(singleline_comment_start) : 0;
   int multiline_comment_start_length = multiline_comment_start ? strlen(multiline_comment_start) : 0;
@@ -273,25 +410,24 @@ void editorUpdateSyntax(erow *row) {
 
   int previous_separator = 1;
   int in_string = 0;
-  int in_comment = (row->index > 0 && E.row[row->index - 1].highlight_open_comment);
 
   int i = 0;
-  while (i < row->rendered_size) {
-    char c = row->rendered_characters[i];
-    unsigned char prev_highlight = (i > 0) ? row->highlight[i - 1] : HL_NORMAL;
+  while (i < size) {
+    char c = text[i];
+    unsigned char prev_highlight = (i > 0) ? highlight[i - 1] : HL_NORMAL;
 
     if (singleline_comment_start_length && !in_string && !in_comment) {
-      if (!strncmp(&row->rendered_characters[i], singleline_comment_start, singleline_comment_start_length)) {
-        memset(&row->highlight[i], HL_COMMENT, row->rendered_size - i);
+      if (!strncmp(&text[i], singleline_comment_start, singleline_comment_start_length)) {
+        memset(&highlight[i], HL_COMMENT, size - i);
         break;
       }
     }
 
     if (multiline_comment_start_length && multiline_comment_end_length && !in_string) {
       if (in_comment) {
-        row->highlight[i] = HL_MLCOMMENT;
-        if (!strncmp(&row->rendered_characters[i], multiline_comment_end, multiline_comment_end_length)) {
-          memset(&row->highlight[i], HL_MLCOMMENT, multiline_comment_end_length);
+        highlight[i] = HL_MLCOMMENT;
+        if (!strncmp(&text[i], multiline_comment_end, multiline_comment_end_length)) {
+          memset(&highlight[i], HL_MLCOMMENT, multiline_comment_end_length);
           i += multiline_comment_end_length;
           in_comment = 0;
           previous_separator = 1;
@@ -300,19 +436,19 @@ void editorUpdateSyntax(erow *row) {
           i++;
           continue;
         }
-      } else if (!strncmp(&row->rendered_characters[i], multiline_comment_start, multiline_comment_start_length)) {
-        memset(&row->highlight[i], HL_MLCOMMENT, multiline_comment_start_length);
+      } else if (!strncmp(&text[i], multiline_comment_start, multiline_comment_start_length)) {
+        memset(&highlight[i], HL_MLCOMMENT, multiline_comment_start_length);
         i += multiline_comment_start_length;
         in_comment = 1;
         continue;
       }
     }
 
-    if (E.syntax->flags & HL_HIGHLIGHT_STRINGS) {
+    if (syntax->flags & HL_HIGHLIGHT_STRINGS) {
       if (in_string) {
-        row->highlight[i] = HL_STRING;
-        if (c == '\\' && i + 1 < row->rendered_size) {
-          row->highlight[i + 1] = HL_STRING;
+        highlight[i] = HL_STRING;
+        if (c == '\\' && i + 1 < size) {
+          highlight[i + 1] = HL_STRING;
           i += 2;
           continue;
         }
@@ -323,16 +459,16 @@ void editorUpdateSyntax(erow *row) {
       } else {
         if (c == '"' || c == '\'') {
           in_string = c;
-          row->highlight[i] = HL_STRING;
+          highlight[i] = HL_STRING;
           i++;
           continue;
         }
       }
     }
 
-    if (E.syntax->flags & HL_HIGHLIGHT_NUMBERS) {
+    if (syntax->flags & HL_HIGHLIGHT_NUMBERS) {
       if ((isdigit(c) && (previous_separator || prev_highlight == HL_NUMBER)) || (c == '.' && prev_highlight == HL_NUMBER)) {
-        row->highlight[i] = HL_NUMBER;
+        highlight[i] = HL_NUMBER;
         i++;
         previous_separator = 0;
         continue;
@@ -340,20 +476,11 @@ void editorUpdateSyntax(erow *row) {
     }
 
     if (previous_separator) {
-      int j;
-      for (j = 0; keywords[j]; j++) {
-        int klen = strlen(keywords[j]);
-        int kw2 = keywords[j][klen - 1] == '|';
-        if (kw2) klen--;
-
-        if (!strncmp(&row->rendered_characters[i], keywords[j], klen) &&
-            is_separator(row->rendered_characters[i + klen])) {
-          memset(&row->highlight[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
-          i += klen;
-          break;
-        }
-      }
-      if (keywords[j] != NULL) {
+      unsigned char type;
+      int klen = editorMatchKeyword(syntax->keyword_trie, &text[i], &type);
+      if (klen) {
+        memset(&highlight[i], type, klen);
+        i += klen;
         previous_separator = 0;
         continue;
       }
@@ -363,10 +490,251 @@ void editorUpdateSyntax(erow *row) {
     i++;
   }
 
-  int changed = (row->highlight_open_comment != in_comment);
-  row->highlight_open_comment = in_comment;
-  if (changed && row->index + 1 < E.number_of_rows)
-    editorUpdateSyntax(&E.row[row->index + 1]);
+  return in_comment;
+}
+
+int editorSyntaxStartState(erow *row) {
+  return row->index > 0 ? E.row[row->index - 1].highlight_open_comment : 0;
+}
+
+int editorSyntaxOutdated(erow *row) {
+  return row->highlight_stale || row->highlight_start_comment != editorSyntaxStartState(row);
+}
+
+void editorSyntaxCheckpoint(erow *row, int start, int open) {
+  row->highlight_stale = 0;
+  row->highlight_start_comment = start;
+  row->highlight_open_comment = open;
+}
+
+void editorUpdateSyntax(erow *row) {
+  int start = editorSyntaxStartState(row);
+  if (row->highlight == NULL) row->highlight = slabAlloc(row->rendered_size);
+  int open = editorHighlightText(E.syntax, editorRowRendered(row), row->rendered_size, start, row->highlight);
+  editorSyntaxCheckpoint(row, start, open);
+  row->highlight_dirty = 0;
+}
+
+void editorScanSyntax(erow *row) {
+  static unsigned char *scratch = NULL;
+  static int scratch_size = 0;
+
+  if (row->rendered_size > scratch_size) {
+    scratch_size = row->rendered_size * 2;
+    scratch = realloc(scratch, scratch_size);
+    if (scratch == NULL) die("realloc");
+  }
+  int start = editorSyntaxStartState(row);
+  int open = editorHighlightText(E.syntax, editorRowRendered(row), row->rendered_size, start, scratch);
+  editorSyntaxCheckpoint(row, start, open);
+  row->highlight_dirty = 1;
+}
+
+int editorSyntaxEnsure(int filerow, int force) {
+  if (!force && E.syntax && filerow - E.syntax_valid_rows > TEXOR_SYNTAX_SYNC_ROWS) return 0;
+
+  while (E.syntax_valid_rows < filerow) {
+    erow *row = &E.row[E.syntax_valid_rows];
+    if (editorSyntaxOutdated(row)) editorScanSyntax(row);
+    E.syntax_valid_rows++;
+  }
+
+  erow *row = &E.row[filerow];
+  if (editorSyntaxOutdated(row) || row->highlight_dirty) editorUpdateSyntax(row);
+  if (E.syntax_valid_rows == filerow) E.syntax_valid_rows++;
+  return 1;
+}
+
+void editorSyntaxInvalidate(int at) {
+  if (at < E.syntax_valid_rows) E.syntax_valid_rows = at;
+  if (at < E.syntax_invalid_end) E.syntax_invalid_end++;
+  else E.syntax_invalid_end = at + 1;
+  E.syntax_version++;
+
+  if (SW.started) {
+    pthread_mutex_lock(&SW.lock);
+    SW.version = E.syntax_version;
+    pthread_mutex_unlock(&SW.lock);
+  }
+}
+
+/*** syntax worker ***/
+
+void editorSyntaxFreeJob(struct syntaxJob *job) {
+  free(job->highlight);
+  free(job->rows);
+  free(job->text);
+  free(job);
+}
+
+void editorSyntaxRunJob(struct syntaxJob *job, int *carry) {
+  if (job->start_comment >= 0) *carry = job->start_comment;
+
+  for (int i = 0; i < job->count; i++) {
+    struct syntaxJobRow *r = &job->rows[i];
+    if (!r->outdated && r->start_comment == *carry) {
+      *carry = r->open_comment;
+      continue;
+    }
+    r->highlight = &job->highlight[r->offset];
+    r->start_comment = *carry;
+    r->open_comment = editorHighlightText(job->syntax, &job->text[r->offset], r->size, *carry, r->highlight);
+    *carry = r->open_comment;
+  }
+}
+
+void *editorSyntaxWorkerMain(void *arg) {
+  (void) arg;
+  int carry = 0;
+
+  pthread_mutex_lock(&SW.lock);
+  while (1) {
+    while (SW.todo == NULL) pthread_cond_wait(&SW.wake, &SW.lock);
+    struct syntaxJob *job = SW.todo;
+    SW.todo = job->next;
+    if (SW.todo == NULL) SW.todo_tail = NULL;
+    int current = (job->version == SW.version);
+    pthread_mutex_unlock(&SW.lock);
+
+    if (current) editorSyntaxRunJob(job, &carry);
+
+    pthread_mutex_lock(&SW.lock);
+    job->next = NULL;
+    if (SW.done_tail) SW.done_tail->next = job;
+    else SW.done = job;
+    SW.done_tail = job;
+    while (write(SW.notify[1], "", 1) == -1 && errno == EINTR) {}
+  }
+  return NULL;
+}
+
+void editorSyntaxStartWorker() {
+  if (SW.started) return;
+  if (pipe(SW.notify) == -1) die("pipe");
+  fcntl(SW.notify[0], F_SETFL, O_NONBLOCK);
+  fcntl(SW.notify[1], F_SETFL, O_NONBLOCK);
+  pthread_mutex_init(&SW.lock, NULL);
+  pthread_cond_init(&SW.wake, NULL);
+  SW.version = E.syntax_version;
+  SW.posted_version = E.syntax_version - 1;
+  if (pthread_create(&SW.thread, NULL, editorSyntaxWorkerMain, NULL) != 0) die("pthread_create");
+  SW.started = 1;
+}
+
+void editorSyntaxPost(int first, int count) {
+  struct syntaxJob *job = malloc(sizeof(struct syntaxJob));
+  if (job == NULL) die("malloc");
+  job->version = E.syntax_version;
+  job->syntax = E.syntax;
+  job->first = first;
+  job->count = count;
+  job->start_comment = -1;
+  if (!SW.chained) job->start_comment = first > 0 ? E.row[first - 1].highlight_open_comment : 0;
+  job->rows = malloc(sizeof(struct syntaxJobRow) * count);
+  if (job->rows == NULL) die("malloc");
+
+  int total = 0;
+  for (int i = 0; i < count; i++) total += E.row[first + i].rendered_size + 1;
+  job->text = malloc(total);
+  job->highlight = malloc(total);
+  if (job->text == NULL || job->highlight == NULL) die("malloc");
+
+  int offset = 0;
+  for (int i = 0; i < count; i++) {
+    erow *row = &E.row[first + i];
+    struct syntaxJobRow *r = &job->rows[i];
+    r->offset = offset;
+    r->size = row->rendered_size;
+    r->start_comment = row->highlight_start_comment;
+    r->open_comment = row->highlight_open_comment;
+    r->outdated = row->highlight_stale || row->highlight_dirty;
+    r->highlight = NULL;
+    memcpy(&job->text[offset], editorRowRendered(row), row->rendered_size + 1);
+    offset += row->rendered_size + 1;
+  }
+
+  pthread_mutex_lock(&SW.lock);
+  job->next = NULL;
+  if (SW.todo_tail) SW.todo_tail->next = job;
+  else SW.todo = job;
+  SW.todo_tail = job;
+  pthread_cond_signal(&SW.wake);
+  pthread_mutex_unlock(&SW.lock);
+
+  SW.inflight++;
+  SW.chained = 1;
+}
+
+void editorSyntaxSchedule() {
+  if (E.syntax == NULL) return;
+  editorSyntaxStartWorker();
+
+  if (SW.posted_version != E.syntax_version) {
+    SW.posted_version = E.syntax_version;
+    SW.next_row = E.syntax_valid_rows;
+    SW.chained = 0;
+    SW.batch = TEXOR_SYNTAX_MIN_BATCH;
+  }
+  if (!SW.chained && SW.next_row < E.syntax_valid_rows) SW.next_row = E.syntax_valid_rows;
+
+  while (SW.inflight < TEXOR_SYNTAX_INFLIGHT && SW.next_row < E.number_of_rows) {
+    int count = E.number_of_rows - SW.next_row;
+    if (count > SW.batch) count = SW.batch;
+    editorSyntaxPost(SW.next_row, count);
+    SW.next_row += count;
+    if (SW.batch < TEXOR_SYNTAX_MAX_BATCH) SW.batch *= 2;
+  }
+}
+
+void editorSyntaxInstall(struct syntaxJob *job) {
+  int carry = job->start_comment;
+  for (int i = 0; i < job->count; i++) {
+    erow *row = &E.row[job->first + i];
+    struct syntaxJobRow *r = &job->rows[i];
+    if (r->highlight) {
+      if (row->highlight == NULL) row->highlight = slabAlloc(row->rendered_size);
+      memcpy(row->highlight, r->highlight, r->size);
+      editorSyntaxCheckpoint(row, r->start_comment, r->open_comment);
+      row->highlight_dirty = 0;
+    }
+    carry = r->open_comment;
+  }
+
+  int end = job->first + job->count;
+  if (E.syntax_valid_rows < job->first) return;
+  if (E.syntax_valid_rows < end) E.syntax_valid_rows = end;
+
+  if (end >= E.syntax_invalid_end &&
+      (end == E.number_of_rows || E.row[end].highlight_start_comment == carry)) {
+    E.syntax_valid_rows = E.number_of_rows;
+    E.syntax_invalid_end = 0;
+    SW.next_row = E.number_of_rows;
+  }
+}
+
+int editorSyntaxCollect() {
+  if (!SW.started) return 0;
+
+  char drain[64];
+  while (read(SW.notify[0], drain, sizeof(drain)) > 0) {}
+
+  pthread_mutex_lock(&SW.lock);
+  struct syntaxJob *job = SW.done;
+  SW.done = SW.done_tail = NULL;
+  pthread_mutex_unlock(&SW.lock);
+
+  int valid = E.syntax_valid_rows;
+  while (job) {
+    struct syntaxJob *next = job->next;
+    SW.inflight--;
+    if (job->version == E.syntax_version) editorSyntaxInstall(job);
+    editorSyntaxFreeJob(job);
+    job = next;
+  }
+  editorSyntaxSchedule();
+
+  return E.syntax_valid_rows > valid &&
+         valid + TEXOR_SYNTAX_SYNC_ROWS < E.row_offset + E.screen_rows;
 }
 
 int editorSyntaxToColor(int hl) {
@@ -382,6 +750,15 @@ int editorSyntaxToColor(int hl) {
   }
 }
 
+void editorBuildColorEscapes() {
+  for (int hl = 0; hl < 256; hl++) {
+    struct colorEscape *escape = &COLORS[hl];
+    escape->color = hl == HL_NORMAL ? -1 : editorSyntaxToColor(hl);
+    escape->length = snprintf(escape->sequence, sizeof(escape->sequence), "\x1b[%dm",
+                              escape->color == -1 ? 39 : escape->color);
+  }
+}
+
 void editorSelectSyntaxHighlight() {
   E.syntax = NULL;
   if (E.filename == NULL) return;
@@ -399,8 +776,10 @@ void editorSelectSyntaxHighlight() {
 
         int filerow;
         for (filerow = 0; filerow < E.number_of_rows; filerow++) {
-          editorUpdateSyntax(&E.row[filerow]);
+          E.row[filerow].highlight_stale = 1;
         }
+        editorSyntaxInvalidate(0);
+        E.syntax_invalid_end = E.number_of_rows;
 
         return;
       }
@@ -411,7 +790,41 @@ void editorSelectSyntaxHighlight() {
 
 /*** row operations ***/
 
+size_t editorRowColumnsOffset(int rendered_size) {
+  return (rendered_size + sizeof(int)) & ~(sizeof(int) - 1);
+}
+
+int *editorRowColumns(erow *row) {
+  if (row->rendered_characters == NULL || row->rendered_size < TEXOR_COLUMN_MAP_MIN) return NULL;
+  return (int *) &row->rendered_characters[editorRowColumnsOffset(row->rendered_size)];
+}
+
+size_t editorRowRenderedBytes(erow *row) {
+  int *columns = editorRowColumns(row);
+  if (columns == NULL) return row->rendered_size + 1;
+  return (char *) &columns[1 + 2*columns[0]] - row->rendered_characters;
+}
+
+int editorRowColumnSearch(int *columns, int field, int value) {
+  int low = 0, high = columns[0];
+  while (low < high) {
+    int middle = (low + high) / 2;
+    if (columns[1 + 2*middle + field] < value) low = middle + 1;
+    else high = middle;
+  }
+  return low;
+}
+
 int editorRowFilePositionXToScreenPositionX(erow *row, int file_position_x) {
+  if (row->rendered_characters == NULL) return file_position_x;
+  int *columns = editorRowColumns(row);
+  if (columns) {
+    int tabs = editorRowColumnSearch(columns, 0, file_position_x);
+    if (tabs == 0) return file_position_x;
+    int *tab = &columns[2*tabs - 1];
+    return tab[1] + file_position_x - tab[0] - 1;
+  }
+
   int screen_position_x = 0;
   int j;
   for (j = 0; j < file_position_x; j++) {
@@ -423,6 +836,19 @@ int editorRowFilePositionXToScreenPositionX(erow *row, int file_position_x) {
 }
 
 int editorRowScreenPositionXToFilePositionX(erow *row, int screen_position_x) {
+  int *columns = editorRowColumns(row);
+  if (row->rendered_characters == NULL || columns) {
+    int file_position_x = screen_position_x;
+    int tabs = columns ? editorRowColumnSearch(columns, 1, screen_position_x + 1) : 0;
+    if (tabs > 0) {
+      int *tab = &columns[2*tabs - 1];
+      file_position_x = tab[0] + 1 + screen_position_x - tab[1];
+    }
+    if (columns && tabs < columns[0] && file_position_x > columns[1 + 2*tabs])
+      file_position_x = columns[1 + 2*tabs];
+    return file_position_x < row->size ? file_position_x : row->size;
+  }
+
   int cur_screen_position_x = 0;
   int file_position_x;
   for (file_position_x = 0; file_position_x < row->size; file_position_x++) {
@@ -435,31 +861,62 @@ int editorRowScreenPositionXToFilePositionX(erow *row, int screen_position_x) {
   return file_position_x;
 }
 
-void editorUpdateRow(erow *row) {
+char *editorRowRendered(erow *row) {
+  return row->rendered_characters ? row->rendered_characters : row->characters;
+}
+
+void editorRenderRow(erow *row) {
   int tabs = 0;
+  int size = 0;
   int j;
-  for (j = 0; j < row->size; j++)
-    if (row->characters[j] == '\t') tabs++;
+  for (j = 0; j < row->size; j++) {
+    if (row->characters[j] == '\t') {
+      tabs++;
+      size += TEXOR_TAB_STOP - size % TEXOR_TAB_STOP;
+    } else {
+      size++;
+    }
+  }
 
-  free(row->rendered_characters);
-  row->rendered_characters = malloc(row->size + tabs*(TEXOR_TAB_STOP - 1) + 1);
+  row->rendered_characters = NULL;
+  row->rendered_size = row->size;
+  if (tabs == 0) return;
 
+  row->rendered_size = size;
+  size_t bytes = size + 1;
+  if (size >= TEXOR_COLUMN_MAP_MIN) bytes = editorRowColumnsOffset(size) + (1 + 2*tabs) * sizeof(int);
+  row->rendered_characters = slabAlloc(bytes);
+  int *tab = editorRowColumns(row);
+  if (tab) *tab++ = tabs;
   int index = 0;
   for (j = 0; j < row->size; j++) {
     if (row->characters[j] == '\t') {
       row->rendered_characters[index++] = ' ';
       while (index % TEXOR_TAB_STOP != 0) row->rendered_characters[index++] = ' ';
+      if (tab) {
+        *tab++ = j;
+        *tab++ = index;
+      }
     } else {
       row->rendered_characters[index++] = row->characters[j];
     }
   }
   row->rendered_characters[index] = '\0';
-  row->rendered_size = index;
+}
 
-  editorUpdateSyntax(row);
+void editorUpdateRow(erow *row) {
+  slabFree(row->rendered_characters, editorRowRenderedBytes(row));
+  slabFree(row->highlight, row->rendered_size);
+  row->highlight = NULL;
+  editorRenderRow(row);
+
+  row->highlight_stale = 1;
+  row->highlight_dirty = 1;
+  editorSyntaxInvalidate(row->index);
 }
 
 void editorInsertRow(int at, char *s, size_t len) {
+  assert(searchCounterIdle());
   if (at < 0 || at > E.number_of_rows) return;
 
   E.row = realloc(E.row, sizeof(erow) * (E.number_of_rows + 1));
@@ -469,7 +926,8 @@ void editorInsertRow(int at, char *s, size_t len) {
   E.row[at].index = at;
 
   E.row[at].size = len;
-  E.row[at].characters = malloc(len + 1);
+  E.row[at].capacity = slabSize(len + 1);
+  E.row[at].characters = slabAlloc(E.row[at].capacity);
   memcpy(E.row[at].characters, s, len);
   E.row[at].characters[len] = '\0';
 
@@ -477,6 +935,7 @@ void editorInsertRow(int at, char *s, size_t len) {
   E.row[at].rendered_characters = NULL;
   E.row[at].highlight = NULL;
   E.row[at].highlight_open_comment = 0;
+  E.row[at].highlight_start_comment = 0;
   editorUpdateRow(&E.row[at]);
 
   E.number_of_rows++;
@@ -484,23 +943,29 @@ void editorInsertRow(int at, char *s, size_t len) {
 }
 
 void editorFreeRow(erow *row) {
-  free(row->rendered_characters);
-  free(row->characters);
-  free(row->highlight);
+  slabFree(row->rendered_characters, editorRowRenderedBytes(row));
+  slabFree(row->characters, row->capacity);
+  slabFree(row->highlight, row->rendered_size);
 }
 
 void editorDelRow(int at) {
+  assert(searchCounterIdle());
   if (at < 0 || at >= E.number_of_rows) return;
   editorFreeRow(&E.row[at]);
   memmove(&E.row[at], &E.row[at + 1], sizeof(erow) * (E.number_of_rows - at - 1));
   for (int j = at; j < E.number_of_rows - 1; j++) E.row[j].index--;
   E.number_of_rows--;
+  editorSyntaxInvalidate(at);
   E.dirty++;
 }
 
 void editorRowInsertChar(erow *row, int at, int c) {
+  assert(searchCounterIdle());
   if (at < 0 || at > row->size) at = row->size;
-  row->characters = realloc(row->characters, row->size + 2);
+  if (row->size + 2 > row->capacity) {
+    row->characters = slabRealloc(row->characters, row->capacity, row->size + 2);
+    row->capacity = slabSize(row->size + 2);
+  }
   memmove(&row->characters[at + 1], &row->characters[at], row->size - at + 1);
   row->size++;
   row->characters[at] = c;
@@ -509,6 +974,7 @@ void editorRowInsertChar(erow *row, int at, int c) {
 }
 
 void editorRowDelChar(erow *row, int at) {
+  assert(searchCounterIdle());
   if (at < 0 || at >= row->size) return;
   memmove(&row->characters[at], &row->characters[at + 1], row->size - at);
   row->size--;
@@ -527,7 +993,11 @@ void editorInsertChar(int c) {
 }
 
 void editorRowAppendString(erow *row, char *s, size_t len) {
-  row->characters = realloc(row->characters, row->size + len + 1);
+  assert(searchCounterIdle());
+  if (row->size + (int) len + 1 > row->capacity) {
+    row->characters = slabRealloc(row->characters, row->capacity, row->size + len + 1);
+    row->capacity = slabSize(row->size + len + 1);
+  }
   memcpy(&row->characters[row->size], s, len);
   row->size += len;
   row->characters[row->size] = '\0';
@@ -610,6 +1080,20 @@ void editorOpen(char *filename) {
   E.dirty = 0;
 }
 
+void editorClose() {
+  assert(searchCounterIdle());
+  for (int j = 0; j < E.number_of_rows; j++) {
+    erow *row = &E.row[j];
+    if (row->capacity > SLAB_MAX_SIZE) slabFree(row->characters, row->capacity);
+    if (editorRowRenderedBytes(row) > SLAB_MAX_SIZE) slabFree(row->rendered_characters, editorRowRenderedBytes(row));
+    if (row->rendered_size > SLAB_MAX_SIZE) slabFree(row->highlight, row->rendered_size);
+  }
+  slabReleaseAll();
+  free(E.row);
+  E.row = NULL;
+  E.number_of_rows = 0;
+}
+
 void editorSave() {
   if (E.filename == NULL) {
     E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL);
@@ -643,8 +1127,484 @@ void editorSave() {
 
 /*** find **/
 
+struct searchPattern {
+  const char *needle;
+  int length;
+  int shift[256];
+  long scanned;
+  long false_hits;
+};
+
+void searchCompile(struct searchPattern *p, const char *needle) {
+  p->needle = needle;
+  p->length = strlen(needle);
+  for (int c = 0; c < 256; c++) p->shift[c] = p->length;
+  for (int i = 0; i < p->length - 1; i++) p->shift[(unsigned char) needle[i]] = p->length - 1 - i;
+  p->scanned = 0;
+  p->false_hits = 0;
+}
+
+int searchMemchr(struct searchPattern *p, const char *s, int n) {
+  int m = p->length;
+  const char *end = s + n - m + 1;
+  const char *hit = s;
+  while ((hit = memchr(hit, p->needle[0], end - hit)) != NULL) {
+    if (!memcmp(hit + 1, &p->needle[1], m - 1)) {
+      p->scanned += hit - s;
+      return hit - s;
+    }
+    p->false_hits++;
+    hit++;
+  }
+  p->scanned += n;
+  return -1;
+}
+
+int searchHorspool(const struct searchPattern *p, const char *s, int n, int i) {
+  int m = p->length;
+  char last = p->needle[m - 1];
+  while (i <= n - m) {
+    char c = s[i + m - 1];
+    if (c == last && !memcmp(&s[i], p->needle, m - 1)) return i;
+    i += p->shift[(unsigned char) c];
+  }
+  return -1;
+}
+
+#ifdef TEXOR_SEARCH_SSE2
+int searchFilterSse2(const struct searchPattern *p, const char *s, int n) {
+  int m = p->length;
+  int last_start = n - m;
+  __m128i first = _mm_set1_epi8(p->needle[0]);
+  __m128i last = _mm_set1_epi8(p->needle[m - 1]);
+  for (int i = 0; ; i += 16) {
+    if (i > last_start - 15) i = last_start - 15;
+    __m128i a = _mm_loadu_si128((const __m128i *) &s[i]);
+    __m128i b = _mm_loadu_si128((const __m128i *) &s[i + m - 1]);
+    unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+    while (mask) {
+      int bit = __builtin_ctz(mask);
+      if (!memcmp(&s[i + bit + 1], &p->needle[1], m - 2)) return i + bit;
+      mask &= mask - 1;
+    }
+    if (i == last_start - 15) return -1;
+  }
+}
+
+__attribute__((target("avx2")))
+int searchFilterAvx2(const struct searchPattern *p, const char *s, int n) {
+  int m = p->length;
+  int last_start = n - m;
+  __m256i first = _mm256_set1_epi8(p->needle[0]);
+  __m256i last = _mm256_set1_epi8(p->needle[m - 1]);
+  for (int i = 0; ; i += 32) {
+    if (i > last_start - 31) i = last_start - 31;
+    __m256i a = _mm256_loadu_si256((const __m256i *) &s[i]);
+    __m256i b = _mm256_loadu_si256((const __m256i *) &s[i + m - 1]);
+    unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+    while (mask) {
+      int bit = __builtin_ctz(mask);
+      if (!memcmp(&s[i + bit + 1], &p->needle[1], m - 2)) return i + bit;
+      mask &= mask - 1;
+    }
+    if (i == last_start - 31) return -1;
+  }
+}
+#endif
+
+int search_has_avx2 = 0;
+
+void searchDetectCpu() {
+#ifdef TEXOR_SEARCH_SSE2
+  __builtin_cpu_init();
+  search_has_avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+int searchFind(struct searchPattern *p, const char *s, int n) {
+  int m = p->length;
+  if (m == 0) return 0;
+  if (m > n) return -1;
+  if (m == 1) {
+    const char *hit = memchr(s, p->needle[0], n);
+    return hit ? hit - s : -1;
+  }
+  if (p->false_hits * TEXOR_SEARCH_MEMCHR_RATIO <= p->scanned + 1024) return searchMemchr(p, s, n);
+
+#ifdef TEXOR_SEARCH_SSE2
+  if (search_has_avx2 && n - m >= 31) return searchFilterAvx2(p, s, n);
+  if (n - m >= 15) return searchFilterSse2(p, s, n);
+#endif
+  return searchHorspool(p, s, n, 0);
+}
+
+struct searchMatch {
+  int row;
+  int offset;
+};
+
+struct searchLevel {
+  char *query;
+  struct searchPattern pattern;
+  struct searchMatch *matches;
+  int count;
+  int capacity;
+  int parent_count;
+  int parent_next;
+  int next_row;
+  int complete;
+};
+
+struct searchSession {
+  struct searchLevel *levels;
+  int depth;
+  int capacity;
+  int entry;
+  int occurrence;
+  int wrap_pending;
+};
+
+struct searchSession SS;
+
+void searchSessionPop() {
+  struct searchLevel *level = &SS.levels[--SS.depth];
+  free(level->query);
+  free(level->matches);
+}
+
+void searchSessionReset() {
+  while (SS.depth > 0) searchSessionPop();
+}
+
+void searchSessionPush(const char *query) {
+  if (SS.depth == SS.capacity) {
+    SS.capacity = SS.capacity ? SS.capacity * 2 : 16;
+    SS.levels = realloc(SS.levels, sizeof(struct searchLevel) * SS.capacity);
+    if (SS.levels == NULL) die("realloc");
+  }
+  struct searchLevel *level = &SS.levels[SS.depth++];
+  level->query = strdup(query);
+  searchCompile(&level->pattern, level->query);
+  level->matches = NULL;
+  level->count = 0;
+  level->capacity = 0;
+  level->parent_count = 0;
+  level->parent_next = 0;
+  level->next_row = 0;
+  level->complete = 0;
+
+  if (SS.depth > 1) {
+    struct searchLevel *parent = &SS.levels[SS.depth - 2];
+    level->parent_count = parent->count;
+    level->next_row = parent->complete ? E.number_of_rows : parent->next_row;
+  }
+}
+
+void searchLevelAppend(struct searchLevel *level, int row, int offset) {
+  if (level->count == level->capacity) {
+    level->capacity = level->capacity ? level->capacity * 2 : 64;
+    level->matches = realloc(level->matches, sizeof(struct searchMatch) * level->capacity);
+    if (level->matches == NULL) die("realloc");
+  }
+  level->matches[level->count].row = row;
+  level->matches[level->count].offset = offset;
+  level->count++;
+}
+
+int searchLevelExtend(struct searchLevel *level) {
+  struct searchLevel *parent = level > SS.levels ? level - 1 : NULL;
+
+  while (level->parent_next < level->parent_count) {
+    struct searchMatch *candidate = &parent->matches[level->parent_next++];
+    erow *row = &E.row[candidate->row];
+    int match = searchFind(&level->pattern, &row->characters[candidate->offset], row->size - candidate->offset);
+    if (match != -1) {
+      searchLevelAppend(level, candidate->row, candidate->offset + match);
+      return 1;
+    }
+  }
+
+  while (level->next_row < E.number_of_rows) {
+    erow *row = &E.row[level->next_row++];
+    int match = searchFind(&level->pattern, row->characters, row->size);
+    if (match != -1) {
+      searchLevelAppend(level, level->next_row - 1, match);
+      return 1;
+    }
+  }
+
+  level->complete = 1;
+  return 0;
+}
+
+int searchLevelAt(struct searchLevel *level, int index) {
+  while (level->count <= index) {
+    if (level->complete || !searchLevelExtend(level)) return 0;
+  }
+  return 1;
+}
+
+struct searchLevel *searchSessionUpdate(const char *query) {
+  int length = strlen(query);
+  while (SS.depth > 0) {
+    struct searchLevel *top = &SS.levels[SS.depth - 1];
+    if (top->pattern.length <= length && !strncmp(top->query, query, top->pattern.length)) break;
+    searchSessionPop();
+  }
+  if (SS.depth == 0 || SS.levels[SS.depth - 1].pattern.length < length) searchSessionPush(query);
+  return &SS.levels[SS.depth - 1];
+}
+
+struct searchCount {
+  int row;
+  int offset;
+  long before;
+};
+
+struct searchCounter {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+  int started;
+  unsigned int generation;
+  char *query;
+  int busy;
+  struct searchCount *entries;
+  int count;
+  int capacity;
+  long total;
+  int done;
+  int error;
+  int notify[2];
+  int waiting;
+};
+
+struct searchCounter SC;
+
+int searchRowOccurrences(struct searchPattern *p, erow *row, int first) {
+  int n = 1;
+  int offset = first;
+  int match;
+  while ((match = searchFind(p, &row->characters[offset + 1], row->size - offset - 1)) != -1) {
+    offset += match + 1;
+    n++;
+  }
+  return n;
+}
+
+int searchOccurrence(struct searchPattern *p, erow *row, int offset, int n) {
+  while (n-- > 0) offset += searchFind(p, &row->characters[offset + 1], row->size - offset - 1) + 1;
+  return offset;
+}
+
+void searchCounterNotify() {
+  while (write(SC.notify[1], "", 1) == -1 && errno == EINTR) {}
+}
+
+void *searchCounterMain(void *arg) {
+  (void) arg;
+  unsigned int seen = 0;
+  struct searchCount *batch = NULL;
+  int batch_capacity = 0;
+
+  pthread_mutex_lock(&SC.lock);
+  while (1) {
+    while (SC.generation == seen) pthread_cond_wait(&SC.wake, &SC.lock);
+    seen = SC.generation;
+    if (SC.query == NULL) continue;
+
+    unsigned int generation = seen;
+    struct searchPattern pattern;
+    char *query = strdup(SC.query);
+    searchCompile(&pattern, query);
+    int rows = E.number_of_rows;
+    SC.busy = 1;
+    pthread_mutex_unlock(&SC.lock);
+
+    long total = 0;
+    int at = 0;
+    int cancelled = 0;
+    int error = 0;
+    while (!cancelled) {
+      int batched = 0;
+      int end = at + TEXOR_SEARCH_COUNT_ROWS < rows ? at + TEXOR_SEARCH_COUNT_ROWS : rows;
+      for (; at < end; at++) {
+        erow *row = &E.row[at];
+        int first = searchFind(&pattern, row->characters, row->size);
+        if (first == -1) continue;
+        if (batched == batch_capacity) {
+          int capacity = batch_capacity ? batch_capacity * 2 : 1024;
+          struct searchCount *grown = realloc(batch, sizeof(struct searchCount) * capacity);
+          if (grown == NULL) {
+            error = errno;
+            break;
+          }
+          batch = grown;
+          batch_capacity = capacity;
+        }
+        batch[batched].row = at;
+        batch[batched].offset = first;
+        batch[batched].before = total;
+        batched++;
+        total += searchRowOccurrences(&pattern, row, first);
+      }
+
+      pthread_mutex_lock(&SC.lock);
+      if (SC.generation != generation) {
+        cancelled = 1;
+      } else if (!error) {
+        if (SC.count + batched > SC.capacity) {
+          int capacity = SC.capacity ? SC.capacity : 1024;
+          while (SC.count + batched > capacity) capacity *= 2;
+          struct searchCount *grown = realloc(SC.entries, sizeof(struct searchCount) * capacity);
+          if (grown == NULL) {
+            error = errno;
+          } else {
+            SC.entries = grown;
+            SC.capacity = capacity;
+          }
+        }
+        if (!error) {
+          memcpy(&SC.entries[SC.count], batch, sizeof(struct searchCount) * batched);
+          SC.count += batched;
+          SC.total = total;
+          if (at == rows) SC.done = 1;
+        }
+      }
+      if (error && !cancelled) {
+        SC.error = error;
+        cancelled = 1;
+      }
+      pthread_mutex_unlock(&SC.lock);
+      searchCounterNotify();
+      if (at == rows) break;
+    }
+
+    free(query);
+    pthread_mutex_lock(&SC.lock);
+    SC.busy = 0;
+    pthread_cond_broadcast(&SC.idle);
+  }
+  return NULL;
+}
+
+void searchCounterPost(const char *query) {
+  if (!SC.started) {
+    if (pipe(SC.notify) == -1) die("pipe");
+    fcntl(SC.notify[0], F_SETFL, O_NONBLOCK);
+    fcntl(SC.notify[1], F_SETFL, O_NONBLOCK);
+    pthread_mutex_init(&SC.lock, NULL);
+    pthread_cond_init(&SC.wake, NULL);
+    pthread_cond_init(&SC.idle, NULL);
+    if (pthread_create(&SC.thread, NULL, searchCounterMain, NULL) != 0) die("pthread_create");
+    SC.started = 1;
+  }
+
+  pthread_mutex_lock(&SC.lock);
+  if (query && SC.query && !strcmp(query, SC.query)) {
+    pthread_mutex_unlock(&SC.lock);
+    return;
+  }
+  free(SC.query);
+  SC.query = query ? strdup(query) : NULL;
+  SC.generation++;
+  SC.count = 0;
+  SC.total = 0;
+  SC.done = 0;
+  SC.error = 0;
+  pthread_cond_signal(&SC.wake);
+  if (query == NULL) {
+    while (SC.busy) pthread_cond_wait(&SC.idle, &SC.lock);
+  }
+  pthread_mutex_unlock(&SC.lock);
+  SC.waiting = query != NULL;
+}
+
+int searchCounterCollect() {
+  char drain[64];
+  while (read(SC.notify[0], drain, sizeof(drain)) > 0) {}
+
+  pthread_mutex_lock(&SC.lock);
+  int error = SC.error;
+  int done = SC.done;
+  if (SC.done || SC.query == NULL) SC.waiting = 0;
+  pthread_mutex_unlock(&SC.lock);
+  if (error) {
+    errno = error;
+    die("realloc");
+  }
+  if (done && SS.wrap_pending) editorFindCallback(SC.query, ARROW_UP);
+  return 1;
+}
+
+int searchCounterIdle() {
+  return !SC.started || SC.query == NULL;
+}
+
+int searchCounted(int entry, struct searchCount *count) {
+  int found = 0;
+  pthread_mutex_lock(&SC.lock);
+  if (entry < SC.count) {
+    *count = SC.entries[entry];
+    found = 1;
+  }
+  pthread_mutex_unlock(&SC.lock);
+  return found;
+}
+
+int searchEntry(struct searchLevel *level, int entry, struct searchMatch *match) {
+  struct searchCount count;
+  if (searchCounted(entry, &count)) {
+    match->row = count.row;
+    match->offset = count.offset;
+    return 1;
+  }
+  if (!searchLevelAt(level, entry)) return 0;
+  *match = level->matches[entry];
+  return 1;
+}
+
+int searchLastEntry() {
+  int last = -1;
+  pthread_mutex_lock(&SC.lock);
+  if (SC.done) last = SC.count - 1;
+  pthread_mutex_unlock(&SC.lock);
+  return last;
+}
+
+int formatCount(char *buf, long n) {
+  char digits[24];
+  int len = snprintf(digits, sizeof(digits), "%ld", n);
+  int out = 0;
+  for (int i = 0; i < len; i++) {
+    if (i > 0 && (len - i) % 3 == 0) buf[out++] = ',';
+    buf[out++] = digits[i];
+  }
+  buf[out] = '\0';
+  return out;
+}
+
+int searchStatus(char *buf, size_t size) {
+  if (!SC.started || SC.query == NULL) return 0;
+
+  char current[32] = "-";
+  char total[32];
+  struct searchCount count;
+  if (SS.entry >= 0) {
+    if (searchCounted(SS.entry, &count)) formatCount(current, count.before + SS.occurrence + 1);
+    else strcpy(current, "?");
+  }
+
+  pthread_mutex_lock(&SC.lock);
+  formatCount(total, SC.total);
+  int done = SC.done;
+  pthread_mutex_unlock(&SC.lock);
+
+  return snprintf(buf, size, "match %s/%s%s", current, total, done ? "" : "+");
+}
+
 void editorFindCallback(char *query, int key) {
-  static int last_match = -1;
   static int direction = 1;
 
   static int saved_highlight_line;
@@ -654,43 +1614,89 @@ void editorFindCallback(char *query, int key) {
     memcpy(E.row[saved_highlight_line].highlight, saved_highlight, E.row[saved_highlight_line].rendered_size);
     saved_highlight = NULL;
   }
+  SS.wrap_pending = 0;
 
   if (key == '\r' || key == '\x1b') {
-    last_match = -1;
+    SS.entry = -1;
     direction = 1;
+    searchSessionReset();
+    searchCounterPost(NULL);
     return;
   } else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
     direction = 1;
   } else if (key == ARROW_LEFT || key == ARROW_UP) {
     direction = -1;
   } else {
-    last_match = -1;
+    SS.entry = -1;
     direction = 1;
   }
 
-  if (last_match == -1) direction = 1;
-  int current = last_match;
-  int i;
-  for (i = 0; i < E.number_of_rows; i++) {
-    current += direction;
-    if (current == -1) current = E.number_of_rows - 1;
-    else if (current == E.number_of_rows) current = 0;
+  struct searchMatch match;
+  int length = strlen(query);
+  if (length > 0) {
+    struct searchLevel *level = searchSessionUpdate(query);
+    searchCounterPost(query);
 
-    erow *row = &E.row[current];
-    char *match = strstr(row->rendered_characters, query);
-    if (match) {
-      last_match = current;
-      E.file_position_y = current;
-      E.file_position_x = editorRowScreenPositionXToFilePositionX(row, match - row->rendered_characters);
-      E.row_offset = E.number_of_rows;
-
-      saved_highlight_line = current;
-      saved_highlight = malloc(row->rendered_size);
-      memcpy(saved_highlight, row->highlight, row->rendered_size);
-      memset(&row->highlight[match - row->rendered_characters], HL_MATCH, strlen(query));
-      break;
+    if (SS.entry == -1) {
+      if (!searchEntry(level, 0, &match)) return;
+      SS.entry = 0;
+      SS.occurrence = 0;
+    } else {
+      match.row = E.file_position_y;
+      match.offset = E.file_position_x;
+      erow *row = &E.row[match.row];
+      if (direction == 1) {
+        int next = searchFind(&level->pattern, &row->characters[match.offset + 1], row->size - match.offset - 1);
+        if (next != -1) {
+          match.offset += next + 1;
+          SS.occurrence++;
+        } else {
+          if (!searchEntry(level, SS.entry + 1, &match)) {
+            SS.entry = -1;
+            searchEntry(level, 0, &match);
+          }
+          SS.entry++;
+          SS.occurrence = 0;
+        }
+      } else {
+        if (SS.occurrence > 0) {
+          searchEntry(level, SS.entry, &match);
+          SS.occurrence--;
+        } else if (SS.entry == 0 && searchLastEntry() == -1) {
+          SS.wrap_pending = 1;
+          searchEntry(level, 0, &match);
+        } else {
+          SS.entry = SS.entry > 0 ? SS.entry - 1 : searchLastEntry();
+          searchEntry(level, SS.entry, &match);
+          SS.occurrence = searchRowOccurrences(&level->pattern, &E.row[match.row], match.offset) - 1;
+        }
+        match.offset = searchOccurrence(&level->pattern, &E.row[match.row], match.offset, SS.occurrence);
+      }
     }
+  } else {
+    searchSessionReset();
+    searchCounterPost(NULL);
+    if (E.number_of_rows == 0) return;
+    int current = SS.entry == -1 ? 0 : SS.entry + direction;
+    if (current == -1) current = E.number_of_rows - 1;
+    else if (current == E.number_of_rows) current = 0;
+    SS.entry = current;
+    match.row = current;
+    match.offset = 0;
   }
+
+  erow *row = &E.row[match.row];
+  editorSyntaxEnsure(match.row, 1);
+  E.file_position_y = match.row;
+  E.file_position_x = match.offset;
+  E.row_offset = E.number_of_rows;
+
+  saved_highlight_line = match.row;
+  saved_highlight = malloc(row->rendered_size);
+  memcpy(saved_highlight, row->highlight, row->rendered_size);
+  int start = editorRowFilePositionXToScreenPositionX(row, match.offset);
+  int end = editorRowFilePositionXToScreenPositionX(row, match.offset + length);
+  memset(&row->highlight[start], HL_MATCH, end - start);
 }
 
 void editorFind() {
@@ -717,22 +1723,33 @@ void editorFind() {
 struct abuf {
   char *b;
   int len;
+  int capacity;
 };
 
-#define ABUF_INIT {NULL, 0}
+#define ABUF_INIT {NULL, 0, 0}
+#define ABUF_MIN_CAPACITY 16384
 
-void abAppend(struct abuf *ab, const char *s, int len) {
-  char *new = realloc(ab->b, ab->len + len);
+int abGrow(struct abuf *ab, int len) {
+  int capacity = ab->capacity ? ab->capacity : ABUF_MIN_CAPACITY;
+  while (capacity < ab->len + len) capacity *= 2;
+  char *new = realloc(ab->b, capacity);
 
-  if (new == NULL) return;
+  if (new == NULL) return 0;
 
-  memcpy(&new[ab->len], s, len);
   ab->b = new;
-  ab->len +=len;
+  ab->capacity = capacity;
+  return 1;
+}
+
+void abAppend(struct abuf *ab, const char *s, int len) {
+  if (ab->len + len > ab->capacity && !abGrow(ab, len)) return;
+
+  memcpy(&ab->b[ab->len], s, len);
+  ab->len += len;
 }
 
-void abFree(struct abuf *ab) {
-  free(ab->b);
+void abReset(struct abuf *ab) {
+  ab->len = 0;
 }
 
 /*** output ***/
@@ -779,40 +1796,42 @@ void editorDrawRows(struct abuf *ab) {
         abAppend(ab, "~", 1);
       }
     } else {
+      int ready = editorSyntaxEnsure(filerow, 0);
       int len = E.row[filerow].rendered_size - E.column_offset;
       if (len < 0) len = 0;
       if (len > E.screen_columns) len = E.screen_columns;
-      char *c = &E.row[filerow].rendered_characters[E.column_offset];
-      unsigned char *highlight = &E.row[filerow].highlight[E.column_offset];
-      int current_color = -1;
-      int j;
-      for (j = 0; j < len; j++) {
+      char *c = &editorRowRendered(&E.row[filerow])[E.column_offset];
+      unsigned char *highlight = ready ? &E.row[filerow].highlight[E.column_offset] : NULL;
+      struct colorEscape *current = &COLORS[HL_NORMAL];
+      int j = 0;
+      while (j < len) {
+        int k = j;
         if (iscntrl(c[j])) {
-          char sym = (c[j] <= 26) ? '@' + c[j] : '?';
+          char symbols[64];
           abAppend(ab, "\x1b[7m", 4);
-          abAppend(ab, &sym, 1);
-          abAppend(ab, "\x1b[m", 3);
-          if (current_color != -1) {
-            char buf[16];
-            int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
-            abAppend(ab, buf, clen);
-          }
-        } else if (highlight[j] == HL_NORMAL) {
-          if (current_color != -1) {
-            abAppend(ab, "\x1b[39m", 5);
-            current_color = -1;
+          while (k < len && iscntrl(c[k])) {
+            int count = 0;
+            for (; k < len && iscntrl(c[k]) && count < (int) sizeof(symbols); k++)
+              symbols[count++] = (c[k] <= 26) ? '@' + c[k] : '?';
+            abAppend(ab, symbols, count);
           }
-          abAppend(ab, &c[j], 1);
+          abAppend(ab, "\x1b[m", 3);
+          if (current->color != -1) abAppend(ab, current->sequence, current->length);
         } else {
-          int color = editorSyntaxToColor(highlight[j]);
-          if (color != current_color) {
-            current_color = color;
-            char buf[16];
-            int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
-            abAppend(ab, buf, clen);
+          struct colorEscape *escape = &COLORS[highlight ? highlight[j] : HL_NORMAL];
+          k++;
+          if (highlight) {
+            while (k < len && COLORS[highlight[k]].color == escape->color && !iscntrl(c[k])) k++;
+          } else {
+            while (k < len && !iscntrl(c[k])) k++;
+          }
+          if (escape->color != current->color) {
+            abAppend(ab, escape->sequence, escape->length);
+            current = escape;
           }
-          abAppend(ab, &c[j], 1);
+          abAppend(ab, &c[j], k - j);
         }
+        j = k;
       }
       abAppend(ab, "\x1b[39m", 5);
     }
@@ -828,9 +1847,12 @@ void editorDrawStatusBar(struct abuf *ab) {
   int len = snprintf(status, sizeof(status), "%.20s - %d lines %s",
       E.filename ? E.filename : "[No Name]", E.number_of_rows,
       E.dirty ? "(modified)" : "");
-  int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d",
-      E.syntax ? E.syntax->file_type : "no ft",
-      E.file_position_y + 1, E.number_of_rows);
+  int rlen = searchStatus(rstatus, sizeof(rstatus));
+  if (rlen == 0) {
+    rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d",
+        E.syntax ? E.syntax->file_type : "no ft",
+        E.file_position_y + 1, E.number_of_rows);
+  }
   if (len > E.screen_columns) len = E.screen_columns;
   abAppend(ab, status, len);
   while (len < E.screen_columns) {
@@ -855,9 +1877,12 @@ void editorDrawMessageBar(struct abuf *ab) {
 }
 
 void editorRefreshScreen() {
+  static struct abuf ab = ABUF_INIT;
+
   editorScroll();
+  editorSyntaxSchedule();
 
-  struct abuf ab = ABUF_INIT;
+  abReset(&ab);
 
   abAppend(&ab, "\x1b[?25l", 6);
   abAppend(&ab, "\x1b[H", 3);
@@ -867,14 +1892,13 @@ void editorRefreshScreen() {
   editorDrawMessageBar(&ab);
 
   char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.file_position_y - E.row_offset) + 1,
-                                            (E.screen_position_x - E.column_offset) + 1);
-  abAppend(&ab, buf, strlen(buf));
+  int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.file_position_y - E.row_offset) + 1,
+                                                      (E.screen_position_x - E.column_offset) + 1);
+  abAppend(&ab, buf, len);
 
   abAppend(&ab, "\x1b[?25h", 6);
 
   write(STDOUT_FILENO, ab.b, ab.len);
-  abFree(&ab);
 }
 
 void editorSetStatusMessage(const char *fmt, ...) {
@@ -887,6 +1911,32 @@ void editorSetStatusMessage(const char *fmt, ...) {
 
 /*** input ***/
 
+void editorWaitForInput() {
+  while (SW.inflight > 0 || SC.waiting) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+    int nfds = STDIN_FILENO;
+    if (SW.inflight > 0) {
+      FD_SET(SW.notify[0], &fds);
+      if (SW.notify[0] > nfds) nfds = SW.notify[0];
+    }
+    if (SC.waiting) {
+      FD_SET(SC.notify[0], &fds);
+      if (SC.notify[0] > nfds) nfds = SC.notify[0];
+    }
+    if (select(nfds + 1, &fds, NULL, NULL, NULL) == -1) {
+      if (errno == EINTR) continue;
+      die("select");
+    }
+    int refresh = 0;
+    if (SW.inflight > 0 && FD_ISSET(SW.notify[0], &fds)) refresh |= editorSyntaxCollect();
+    if (SC.waiting && FD_ISSET(SC.notify[0], &fds)) refresh |= searchCounterCollect();
+    if (refresh) editorRefreshScreen();
+    if (FD_ISSET(STDIN_FILENO, &fds)) return;
+  }
+}
+
 char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
   size_t bufsize = 128;
   char *buf = malloc(bufsize);
@@ -981,6 +2031,7 @@ void editorProcessKeypress() {
         quit_times--;
         return;
       }
+      editorClose();
       write(STDOUT_FILENO, "\x1b[2J", 4);
       write(STDOUT_FILENO, "\x1b[H", 3);
       exit(0);
@@ -1060,6 +2111,18 @@ void initEditor() {
   E.status_message[0] = '\0';
   E.status_message_time = 0;
   E.syntax = NULL;
+  E.syntax_valid_rows = 0;
+  E.syntax_invalid_end = 0;
+  for (unsigned int j = 0; j < HLDB_ENTRIES; j++) editorBuildKeywordTrie(&HLDB[j]);
+  editorBuildColorEscapes();
+  searchDetectCpu();
+  E.syntax_version = 0;
+  SW.started = 0;
+  SW.inflight = 0;
+  SS.entry = -1;
+  SS.wrap_pending = 0;
+  SC.started = 0;
+  SC.waiting = 0;
 
   if (getWindowSize(&E.screen_rows, &E.screen_columns) == -1) die("getWindowSize");
   E.screen_rows -= 2;
@@ -0,0 +1,261 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "input.h"
+#include "terminal.h"
+
+
+// 按键队列的容量，须是 2 的幂。每个输入字节至多产生一个按键，
+// 因此每次读取的字节数不超过队列的剩余空间。
+#define INPUT_QUEUE_SIZE 8192
+#define INPUT_READ_SIZE 4096
+// CSI 序列参数的最大长度，超长的序列整体丢弃。
+#define INPUT_PARAM_MAX 16
+
+enum inputState {
+  INPUT_GROUND = 0,   // 普通字节。
+  INPUT_ESCAPE,       // 已读到 ESC。
+  INPUT_CSI,          // 已读到 ESC [，正在收集参数。
+  INPUT_SS3,          // 已读到 ESC O。
+  INPUT_PASTE         // 处于括号粘贴中，字节原样收集，直到结束标记。
+};
+
+// 括号粘贴的结束标记。粘贴内容本身不会以 ESC 开头的这一序列出现。
+#define PASTE_END "\x1b[201~"
+#define PASTE_END_LEN 6
+
+// 已收到、尚未被取走的粘贴内容，按到达顺序排列，与队列中的 PASTE_KEY 一一对应。
+struct inputPaste {
+  char *text;
+  size_t len;
+  size_t capacity;
+  struct inputPaste *next;
+};
+
+static int queue[INPUT_QUEUE_SIZE];
+static unsigned int head = 0;   // 下一个取出的位置。
+static unsigned int tail = 0;   // 下一个放入的位置。
+
+// 解析状态跨越多次读取保存，序列被拆到两次 read 中也能正确拼接。
+static int state = INPUT_GROUND;
+static char params[INPUT_PARAM_MAX];
+static int param_len = 0;
+
+static struct inputPaste *pastes = NULL;
+static struct inputPaste *receiving = NULL;   // 正在接收的粘贴，已排在 pastes 末尾。
+static int paste_matched = 0;                 // 已匹配的结束标记前缀长度。
+
+static void push(int key) {
+  queue[tail++ % INPUT_QUEUE_SIZE] = key;
+}
+
+static void pasteAppend(const char *s, size_t len) {
+  struct inputPaste *p = receiving;
+  if (p->len + len > p->capacity) {
+    size_t capacity = p->capacity ? p->capacity * 2 : 4096;
+    while (capacity < p->len + len) capacity *= 2;
+    char *text = realloc(p->text, capacity);
+    if (text == NULL) die("realloc");
+    p->text = text;
+    p->capacity = capacity;
+  }
+  memcpy(&p->text[p->len], s, len);
+  p->len += len;
+}
+
+static void pasteBegin(void) {
+  struct inputPaste *p = calloc(1, sizeof(struct inputPaste));
+  if (p == NULL) die("calloc");
+  struct inputPaste **last = &pastes;
+  while (*last) last = &(*last)->next;
+  *last = p;
+  receiving = p;
+  paste_matched = 0;
+  state = INPUT_PASTE;
+}
+
+// 在粘贴中收集字节并查找结束标记，返回消耗的字节数。
+// 不在标记中的连续字节用 memchr 找到下一个 ESC 后整段复制。
+static int pasteFeed(const char *buf, int len) {
+  int i = 0;
+  while (i < len) {
+    if (paste_matched == 0) {
+      const char *esc = memchr(&buf[i], '\x1b', len - i);
+      int run = esc ? esc - &buf[i] : len - i;
+      pasteAppend(&buf[i], run);
+      i += run;
+      if (esc == NULL) break;
+    }
+    if (buf[i] == PASTE_END[paste_matched]) {
+      i++;
+      if (++paste_matched == PASTE_END_LEN) {
+        receiving = NULL;
+        state = INPUT_GROUND;
+        push(PASTE_KEY);
+        break;
+      }
+    } else {
+      // 匹配中断：已匹配的前缀属于粘贴内容，当前字节重新从头匹配。
+      pasteAppend(PASTE_END, paste_matched);
+      paste_matched = 0;
+      if (buf[i] != '\x1b') pasteAppend(&buf[i++], 1);
+    }
+  }
+  return i;
+}
+
+// 由 CSI 序列的参数与结束字节得到按键，无法识别的序列按 ESC 处理。
+static int csiKey(char final) {
+  int n = 0;
+  for (int i = 0; i < param_len && params[i] >= '0' && params[i] <= '9'; i++)
+    n = n * 10 + (params[i] - '0');
+
+  switch (final) {
+    case '~':
+      switch (n) {
+        case 200: return PASTE_KEY;
+        case 1: return HOME_KEY;
+        case 3: return DEL_KEY;
+        case 4: return END_KEY;
+        case 5: return PAGE_UP;
+        case 6: return PAGE_DOWN;
+        case 7: return HOME_KEY;
+        case 8: return END_KEY;
+      }
+      break;
+    case 'A': return ARROW_UP;
+    case 'B': return ARROW_DOWN;
+    case 'C': return ARROW_RIGHT;
+    case 'D': return ARROW_LEFT;
+    case 'H': return HOME_KEY;
+    case 'F': return END_KEY;
+  }
+  return '\x1b';
+}
+
+static void feed(unsigned char c) {
+  switch (state) {
+    case INPUT_GROUND:
+      if (c == '\x1b')
+        state = INPUT_ESCAPE;
+      else
+        push(c);
+      break;
+
+    case INPUT_ESCAPE:
+      if (c == '[') {
+        state = INPUT_CSI;
+        param_len = 0;
+      } else if (c == 'O') {
+        state = INPUT_SS3;
+      } else {
+        // 单独的 ESC 后紧跟普通字节：先交出 ESC，再按普通字节处理。
+        push('\x1b');
+        state = INPUT_GROUND;
+        feed(c);
+      }
+      break;
+
+    case INPUT_CSI:
+      // 参数字节与中间字节为 0x20-0x3f，其余字节结束序列。
+      if (c >= 0x20 && c <= 0x3f) {
+        if (param_len < INPUT_PARAM_MAX)
+          params[param_len++] = c;
+        else
+          param_len = INPUT_PARAM_MAX + 1;
+        break;
+      }
+      int key = param_len > INPUT_PARAM_MAX ? '\x1b' : csiKey(c);
+      state = INPUT_GROUND;
+      // ESC[200~ 开始括号粘贴；之后的字节不再解析，直到 ESC[201~。
+      if (key == PASTE_KEY)
+        pasteBegin();
+      else
+        push(key);
+      break;
+
+    case INPUT_SS3:
+      push(c == 'H' ? HOME_KEY : c == 'F' ? END_KEY : '\x1b');
+      state = INPUT_GROUND;
+      break;
+
+    case INPUT_PASTE:
+      pasteFeed((const char *) &c, 1);
+      break;
+  }
+}
+
+static int readInto(void) {
+  char buf[INPUT_READ_SIZE];
+  unsigned int room = INPUT_QUEUE_SIZE - (tail - head);
+  if (room > sizeof(buf)) room = sizeof(buf);
+  if (room == 0)
+    return -1;
+
+  int nread = read(STDIN_FILENO, buf, room);
+  if (nread == -1) {
+    if (errno == EIO) // 终端已挂断，按 EOF 处理。
+      return 0;
+    if (errno != EAGAIN && errno != EINTR)
+      die("read");
+    return -1;
+  }
+  for (int i = 0; i < nread; i++) {
+    if (state == INPUT_PASTE)
+      i += pasteFeed(&buf[i], nread - i) - 1;
+    else
+      feed(buf[i]);
+  }
+  return nread;
+}
+
+// 不阻塞地读入终端中现有的字节，返回读到的字节数；0 表示终端已关闭（EOF 或挂断），-1 表示暂无数据。
+int inputRead(void) {
+  return readInto();
+}
+
+// 是否停在一个未完成的转义序列中。
+int inputIncomplete(void) {
+  return state == INPUT_ESCAPE || state == INPUT_CSI || state == INPUT_SS3;
+}
+
+// 未完成的转义序列等待超时：说明用户单独按下了 ESC。
+void inputFlushEscape(void) {
+  if (!inputIncomplete())
+    return;
+  push('\x1b');
+  state = INPUT_GROUND;
+}
+
+// 返回队列中完整按键的个数。队列为空时不阻塞地读入终端中已有的全部字节。
+int inputPending(void) {
+  struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+  while (head == tail && poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
+    if (readInto() <= 0)
+      break;
+  return tail - head;
+}
+
+// 取出下一个按键，队列为空时返回 -1。
+int inputNextKey(void) {
+  if (head == tail)
+    return -1;
+  return queue[head++ % INPUT_QUEUE_SIZE];
+}
+
+// 取走最早一次粘贴的内容，由调用者释放。每个 PASTE_KEY 对应调用一次。
+char *inputTakePaste(size_t *len) {
+  struct inputPaste *p = pastes;
+  if (p == NULL || p == receiving) {
+    *len = 0;
+    return NULL;
+  }
+  pastes = p->next;
+  char *text = p->text;
+  *len = p->len;
+  free(p);
+  return text;
+}
@@ -0,0 +1,34 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+
+
+enum editorKey {
+  BACKSPACE = 127,
+  ARROW_LEFT = 1000,
+  ARROW_RIGHT,
+  ARROW_UP,
+  ARROW_DOWN,
+  DEL_KEY,
+  HOME_KEY,
+  END_KEY,
+  PAGE_UP,
+  PAGE_DOWN,
+  PASTE_KEY   // 一次括号粘贴，内容由 inputTakePaste 取出。
+};
+
+int inputRead(void);
+
+int inputIncomplete(void);
+
+void inputFlushEscape(void);
+
+int inputPending(void);
+
+int inputNextKey(void);
+
+char *inputTakePaste(size_t *len);
+
+
+#endif //INPUT_H
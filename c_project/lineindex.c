@@ -0,0 +1,99 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#define LINEINDEX_SSE2
+#endif
+
+#include "lineindex.h"
+#include "terminal.h"
+
+
+void lineIndexInit(struct lineIndex *index) {
+  index->newlines = NULL;
+  index->count = 0;
+  index->capacity = 0;
+}
+
+void lineIndexFree(struct lineIndex *index) {
+  free(index->newlines);
+  lineIndexInit(index);
+}
+
+static void push(struct lineIndex *index, size_t offset) {
+  if (index->count == index->capacity) {
+    size_t capacity = index->capacity ? index->capacity * 2 : 4096;
+    size_t *newlines = realloc(index->newlines, capacity * sizeof(size_t));
+    if (newlines == NULL) die("realloc");
+    index->newlines = newlines;
+    index->capacity = capacity;
+  }
+  index->newlines[index->count++] = offset;
+}
+
+// 通用实现：逐段 memchr。
+static size_t scanMemchr(struct lineIndex *index, const char *buf, size_t len, size_t base) {
+  const char *p = buf;
+  const char *end = buf + len;
+  while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+    push(index, base + (p - buf));
+    p++;
+  }
+  return len;
+}
+
+#ifdef LINEINDEX_SSE2
+// SSE2：每次比较 16 字节，用掩码的各个置位得到换行符位置。
+// 返回已扫描的字节数，剩余不足一个向量的尾部交由 memchr 处理。
+static size_t scanSse2(struct lineIndex *index, const char *buf, size_t len, size_t base) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *) (buf + i));
+    unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+    while (mask) {
+      push(index, base + i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+  return i;
+}
+
+// AVX2：每次比较 32 字节，仅在运行时检测到 CPU 支持时使用。
+__attribute__((target("avx2")))
+static size_t scanAvx2(struct lineIndex *index, const char *buf, size_t len, size_t base) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *) (buf + i));
+    unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline));
+    while (mask) {
+      push(index, base + i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+  return i;
+}
+
+static size_t (*scanVector)(struct lineIndex *index, const char *buf, size_t len, size_t base);
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+// 按 CPU 是否支持 AVX2 选择向量实现。加载线程会并发调用 lineIndexScan，
+// 因此经由 pthread_once 只检测一次，之后各线程只读 scanVector。
+static void chooseScan(void) {
+  __builtin_cpu_init();
+  scanVector = __builtin_cpu_supports("avx2") ? scanAvx2 : scanSse2;
+}
+#endif
+
+// 扫描 buf 中的全部换行符，把 base + 偏移量依次追加到索引。
+void lineIndexScan(struct lineIndex *index, const char *buf, size_t len, size_t base) {
+  size_t done = 0;
+#ifdef LINEINDEX_SSE2
+  pthread_once(&scan_once, chooseScan);
+  done = scanVector(index, buf, len, base);
+#endif
+  scanMemchr(index, buf + done, len - done, base + done);
+}
@@ -0,0 +1,23 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <stddef.h>
+
+
+// 行索引：按顺序记录缓冲区中每个 '\n' 的偏移量。
+// 第 i 行为 [i ? newlines[i - 1] + 1 : 0, newlines[i])，
+// 最后一个换行符之后若还有内容，则构成无换行结尾的最后一行。
+struct lineIndex {
+  size_t *newlines;
+  size_t count;
+  size_t capacity;
+};
+
+void lineIndexInit(struct lineIndex *index);
+
+void lineIndexFree(struct lineIndex *index);
+
+void lineIndexScan(struct lineIndex *index, const char *buf, size_t len, size_t base);
+
+
+#endif //LINEINDEX_H
@@ -0,0 +1,97 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "loader.h"
+#include "terminal.h"
+
+
+// 唤醒主线程的 poll。被信号打断时重试；管道已满（EAGAIN）说明已有未读的通知，丢弃即可。
+static void loaderNotify(struct loader *l) {
+  while (write(l->notify[1], "", 1) == -1 && errno == EINTR) {}
+}
+
+static void *loaderWorker(void *arg) {
+  struct loader *l = arg;
+  while (1) {
+    pthread_mutex_lock(&l->lock);
+    int k = l->next_chunk < l->chunk_count ? l->next_chunk++ : -1;
+    pthread_mutex_unlock(&l->lock);
+    if (k == -1)
+      return NULL;
+
+    struct loadChunk *chunk = &l->chunks[k];
+    lineIndexScan(&chunk->index, l->map + chunk->begin, chunk->end - chunk->begin, chunk->begin);
+
+    pthread_mutex_lock(&l->lock);
+    chunk->done = 1;
+    pthread_cond_broadcast(&l->chunk_done);
+    pthread_mutex_unlock(&l->lock);
+    loaderNotify(l);
+  }
+}
+
+void loaderStart(struct loader *l, const char *map, size_t size, size_t chunk_size) {
+  l->map = map;
+  l->size = size;
+  l->chunk_count = (size + chunk_size - 1) / chunk_size;
+  l->chunks = calloc(l->chunk_count, sizeof(struct loadChunk));
+  if (l->chunks == NULL) die("calloc");
+  for (int k = 0; k < l->chunk_count; k++) {
+    l->chunks[k].begin = (size_t) k * chunk_size;
+    l->chunks[k].end = (k == l->chunk_count - 1) ? size : (size_t) (k + 1) * chunk_size;
+    lineIndexInit(&l->chunks[k].index);
+  }
+  l->next_chunk = 0;
+  l->next_collect = 0;
+  pthread_mutex_init(&l->lock, NULL);
+  pthread_cond_init(&l->chunk_done, NULL);
+  // 通知管道两端都不阻塞：管道写满时丢弃通知也不影响结果，主线程总会再取一次。
+  if (pipe(l->notify) == -1) die("pipe");
+  fcntl(l->notify[0], F_SETFL, O_NONBLOCK);
+  fcntl(l->notify[1], F_SETFL, O_NONBLOCK);
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  l->thread_count = cpus < 1 ? 1 : cpus > LOADER_MAX_THREADS ? LOADER_MAX_THREADS : (int) cpus;
+  if (l->thread_count > l->chunk_count) l->thread_count = l->chunk_count;
+  for (int t = 0; t < l->thread_count; t++)
+    if (pthread_create(&l->threads[t], NULL, loaderWorker, l) != 0) die("pthread_create");
+}
+
+// 按顺序取出下一个块。块尚未完成时，wait 为 0 则返回 NULL，否则阻塞等待。
+// 全部取完后返回 NULL。取出的块的索引由调用者用完后释放。
+struct loadChunk *loaderNext(struct loader *l, int wait) {
+  if (l->next_collect == l->chunk_count)
+    return NULL;
+  struct loadChunk *chunk = &l->chunks[l->next_collect];
+  pthread_mutex_lock(&l->lock);
+  while (wait && !chunk->done)
+    pthread_cond_wait(&l->chunk_done, &l->lock);
+  int done = chunk->done;
+  pthread_mutex_unlock(&l->lock);
+  if (!done)
+    return NULL;
+  l->next_collect++;
+  return chunk;
+}
+
+int loaderPending(const struct loader *l) {
+  return l->chunks != NULL && l->next_collect < l->chunk_count;
+}
+
+// 等待所有工作线程退出并释放加载器；调用前应已取完所有块。
+void loaderFinish(struct loader *l) {
+  for (int t = 0; t < l->thread_count; t++)
+    pthread_join(l->threads[t], NULL);
+  for (int k = 0; k < l->chunk_count; k++)
+    lineIndexFree(&l->chunks[k].index);
+  free(l->chunks);
+  l->chunks = NULL;
+  l->chunk_count = 0;
+  l->thread_count = 0;
+  pthread_mutex_destroy(&l->lock);
+  pthread_cond_destroy(&l->chunk_done);
+  close(l->notify[0]);
+  close(l->notify[1]);
+}
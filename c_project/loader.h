@@ -0,0 +1,44 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "lineindex.h"
+
+
+#define LOADER_MAX_THREADS 8
+
+struct loadChunk {
+  size_t begin;             // 块在映射中的起止偏移。
+  size_t end;
+  struct lineIndex index;   // 块内换行符的偏移（相对整个映射）。
+  int done;
+};
+
+// 并行加载器：把映射切成固定大小的块，由线程池并行建立各块的行索引，
+// 主线程按顺序取出已完成的块拼接成行。
+struct loader {
+  const char *map;
+  size_t size;
+  struct loadChunk *chunks;
+  int chunk_count;
+  int next_chunk;           // 下一个分配给工作线程的块。
+  int next_collect;         // 主线程下一个要取出的块。
+  pthread_mutex_t lock;
+  pthread_cond_t chunk_done;
+  pthread_t threads[LOADER_MAX_THREADS];
+  int thread_count;
+  int notify[2];            // 每完成一块向管道写入一个字节，主循环据此唤醒。
+};
+
+void loaderStart(struct loader *l, const char *map, size_t size, size_t chunk_size);
+
+struct loadChunk *loaderNext(struct loader *l, int wait);
+
+int loaderPending(const struct loader *l);
+
+void loaderFinish(struct loader *l);
+
+
+#endif //LOADER_H
@@ -5,48 +5,45 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "buffer.h"
+#include "input.h"
+#include "lineindex.h"
+#include "loader.h"
+#include "render.h"
+#include "save.h"
+#include "screen.h"
 #include "terminal.h"
+#include "undo.h"
 
 #define TEXOR_TAG "SeedClass_Test by Xian Li"
-#define TEXOR_TAB_STOP 8
 #define TEXOR_QUIT_TIMES 2
 #define INPUT_BUFSIZE 128
+#define TEXOR_PARALLEL_LOAD_MIN (64 << 20) // 超过此大小的文件交给并行加载器。
+#define TEXOR_LOAD_CHUNK_SIZE (8 << 20)    // 并行加载时每块的大小。
+#define TEXOR_SAVE_FSYNC 1                 // 保存时 fsync 临时文件及替换后的目录。
+#define TEXOR_ESCAPE_TIMEOUT_MS 100        // 单独的 ESC 与转义序列开头的区分等待时间。
+#define TEXOR_MESSAGE_SECONDS 5            // 状态消息的显示时长。
+#define TEXOR_UNDO_LIMIT (16 << 20)        // 撤销日志占用内存的上限，超出时淘汰最早的步骤。
 
 // 一个好用的宏，用于计算Ctrl键与字母键组合后的ASCII码。
 // 利用了大多数终端中Ctrl组合键的值等于对应字母ASCII码的低5位这一特性。
 // `& 0x1f` 的结果范围是 0-31。
 #define CTRL_KEY(k) ((k) & 0x1f)
 
-enum editorKey {
-  BACKSPACE = 127,
-  ARROW_LEFT = 1000,
-  ARROW_RIGHT,
-  ARROW_UP,
-  ARROW_DOWN,
-  DEL_KEY,
-  HOME_KEY,
-  END_KEY,
-  PAGE_UP,
-  PAGE_DOWN
-};
-
-typedef struct erow {
-  int size;
-  int rendered_size;
-  char *characters;
-  char *rendered_characters;
-} erow;
-
 struct editorConfig {
   int file_position_x, file_position_y;
   int screen_position_x;
@@ -55,73 +52,42 @@ struct editorConfig {
   int screen_rows;
   int screen_columns;
   int number_of_rows;       // 文件当前总行数。
-  erow *row;                // 代表文件的一行。
+  struct rowBuffer rows;    // 行存储引擎，按行号 O(log n) 查找、插入、删除。
   int dirty;                // 脏标志,大于0表示文件内容自上次保存后已被修改。
   char *filename;
+  char *map;                // 只读映射的文件内容，未修改的行直接指向这里。
+  size_t map_size;
+  struct loader loader;     // 大文件的并行加载器，加载期间其余块在后台建立索引。
+  size_t load_line_start;   // 加载过程中尚未遇到换行符的当前行在映射中的起点。
+  struct undoLog undo;      // 撤销日志，只记录每次修改的差异。
   char status_message[80];  // 临时消息
   time_t status_message_time; // 状态栏消息时间戳，用于自动消失。
+  int prompting;            // 正在 editorPrompt 中输入，此时消息栏显示提示文本，不会到期消失。
 };
 
 struct editorConfig E;
 
+int resize_pipe[2]; // SIGWINCH 处理函数写入一个字节，把信号转成主循环中的事件。
+
 void editorSetStatusMessage(const char *fmt, ...);
+void editorWaitForEvent();
 void editorRefreshScreen();
 char *editorPrompt(char *prompt, void (*callback)(char *, int)); // 显示用户输入提示框并获取输入的函数原型。
 void editorSaveAs();
+int editorLoadPoll(int wait);
+void editorLoadFinish();
 
+// 取第 at 行；at 需在 [0, number_of_rows) 范围内。
+erow *editorRow(int at) {
+  return bufferAt(&E.rows, at);
+}
 
+// 从按键队列取出下一个按键，队列为空时等待事件。转义序列由 input.c 的状态机解析。
 int editorReadKey() {
-  int nread;
-  char c;
-  // 阻塞式读取循环
-  while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-    if (nread == -1 && errno != EAGAIN)
-      die("read");
-  }
-  if (c == '\x1b') {  //ESC
-    char seq[3];
-    //后续没有字节
-    if (read(STDIN_FILENO, &seq[0], 1) != 1)
-      return '\x1b';
-    if (read(STDIN_FILENO, &seq[1], 1) != 1)
-      return '\x1b';
-    // 判断是否是 CSI序列
-    if (seq[0] == '[') {
-      if (seq[1] >= '0' && seq[1] <= '9') {
-        if (read(STDIN_FILENO, &seq[2], 1) != 1)
-          return '\x1b'; // 读取序列的最后一个字符 '~'。
-        if (seq[2] == '~') {
-          switch (seq[1]) {
-            case '1': return HOME_KEY;
-            case '3': return DEL_KEY;
-            case '4': return END_KEY;
-            case '5': return PAGE_UP;
-            case '6': return PAGE_DOWN;
-            case '7': return HOME_KEY;
-            case '8': return END_KEY;
-          }
-        }
-      } else {
-        // 如果第三个字符是字母，通常是箭头
-        switch (seq[1]) {
-          case 'A': return ARROW_UP;
-          case 'B': return ARROW_DOWN;
-          case 'C': return ARROW_RIGHT;
-          case 'D': return ARROW_LEFT;
-          case 'H': return HOME_KEY;
-          case 'F': return END_KEY;
-        }
-      }
-    } else if (seq[0] == 'O') {
-      switch (seq[1]) {
-        case 'H': return HOME_KEY;
-        case 'F': return END_KEY;
-      }
-    }
-    return '\x1b';
-  } else {
-    return c;
-  }
+  int c;
+  while ((c = inputNextKey()) == -1)
+    editorWaitForEvent();
+  return c;
 }
 
 
@@ -129,8 +95,10 @@ int getCursorPosition(int *rows, int *cols) {
   char buf[32];
   unsigned int i = 0;
   if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4) return -1;
+  struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
   while (i < sizeof(buf) - 1) {
-    if (read(STDIN_FILENO, &buf[i], 1) != 1) break;
+    // 终端设置为不等待的读取，应答需先用 poll 等到。
+    if (poll(&pfd, 1, 1000) != 1 || read(STDIN_FILENO, &buf[i], 1) != 1) break;
     if (buf[i] == 'R') break;
     i++;
   }
@@ -155,163 +123,420 @@ int getWindowSize(int *rows, int *cols) {
 
 
 
+// 由渲染缓存中记下的制表符位置换算，不必从行首遍历。
 int editorRowFilePositionXToScreenPositionX(erow *row, int file_position_x) {
-  int screen_position_x = 0;
-  // 遍历到目标逻辑位置前的所有字符
-  for (int j = 0; j < file_position_x; j++) {
-    if (row->characters[j] == '\t')
-      screen_position_x += (TEXOR_TAB_STOP - 1) - (screen_position_x % TEXOR_TAB_STOP);
-    screen_position_x++;
-  }
-  return screen_position_x;
+  return renderColumn(row, file_position_x);
 }
+// 行内容改变后调用。渲染推迟到该行真正被绘制时进行。
 void editorUpdateRow(erow *row) {
-  int tabs = 0;
-  int j;
-  for (j = 0; j < row->size; j++)
-    if (row->characters[j] == '\t') tabs++;
-
-  free(row->rendered_characters);
-  row->rendered_characters = malloc(row->size + tabs * (TEXOR_TAB_STOP - 1) + 1);
-
-  int index = 0;
-  for (j = 0; j < row->size; j++) {
-    if (row->characters[j] == '\t') {
-      row->rendered_characters[index++] = ' ';
-      while (index % TEXOR_TAB_STOP != 0) row->rendered_characters[index++] = ' ';
-    } else {
-      row->rendered_characters[index++] = row->characters[j];
-    }
-  }
-  row->rendered_characters[index] = '\0';
-  row->rendered_size = index;
+  renderInvalidate(row);
 }
 
-void editorInsertRow(int at, char *s, size_t len) {
-  if (at < 0 || at > E.number_of_rows) return;
+// 行在 at 处删去 removed 字节、插入 inserted 字节后调用，长行只重新渲染受影响的部分。
+void editorUpdateRowRange(erow *row, int at, int removed, int inserted) {
+  renderEdit(row, at, removed, inserted);
+}
+
+// 编辑进行中时把一次修改连同其文本记入撤销日志。
+void editorRecord(int type, int y, int x, int count, const char *s, size_t len) {
+  char *text = undoRecord(&E.undo, type, y, x, count, len, 0);
+  if (text) memcpy(text, s, len);
+}
 
-  E.row = realloc(E.row, sizeof(erow) * (E.number_of_rows + 1));
-  memmove(&E.row[at + 1], &E.row[at], sizeof(erow) * (E.number_of_rows - at));
+// 记下键入或删除的单个字符。只有这样的记录会与相邻的同类修改合并。
+void editorRecordKey(int type, int y, int x, char ch) {
+  char *text = undoRecord(&E.undo, type, y, x, 0, 1, 1);
+  if (text) *text = ch;
+}
 
-  E.row[at].size = len;
-  E.row[at].characters = malloc(len + 1);
-  memcpy(E.row[at].characters, s, len);
-  E.row[at].characters[len] = '\0';
+void editorInsertRow(int at, const char *s, size_t len) {
+  if (at < 0 || at > E.number_of_rows) return;
 
-  E.row[at].rendered_size = 0;
-  E.row[at].rendered_characters = NULL;
-  editorUpdateRow(&E.row[at]);
+  editorRecord(UNDO_INSERT_ROWS, at, 0, 1, s, len);
+  erow *row = bufferInsert(&E.rows, at);
+  rowInit(row, s, len);
+  editorUpdateRow(row);
 
   E.number_of_rows++;
   E.dirty++;
 }
 
 void editorFreeRow(erow *row) {
-  free(row->rendered_characters);
-  free(row->characters);
+  renderInvalidate(row);
+  rowFree(row);
 }
 
 void editorDelRow(int at) {
   if (at < 0 || at >= E.number_of_rows) return;
-  editorFreeRow(&E.row[at]);
-  memmove(&E.row[at], &E.row[at + 1], sizeof(erow) * (E.number_of_rows - at - 1));
+  erow *row = editorRow(at);
+  if (E.undo.recording) editorRecord(UNDO_DELETE_ROW, at, 0, 1, rowText(row), row->size);
+  editorFreeRow(row);
+  bufferDelete(&E.rows, at);
   E.number_of_rows--;
   E.dirty++;
 }
 
 void editorRowInsertChar(erow *row, int at, int c) {
   if (at < 0 || at > row->size) at = row->size;
-  row->characters = realloc(row->characters, row->size + 2);
-  memmove(&row->characters[at + 1], &row->characters[at], row->size - at + 1);
-  row->size++;
-  row->characters[at] = c;
-  editorUpdateRow(row);
+  char ch = c;
+  if (E.undo.recording) editorRecordKey(UNDO_INSERT_TEXT, bufferIndexOf(&E.rows, row), at, ch);
+  rowInsert(row, at, &ch, 1);
+  editorUpdateRowRange(row, at, 0, 1);
   E.dirty++;
 }
 
-void editorRowAppendString(erow *row, char *s, size_t len) {
-  row->characters = realloc(row->characters, row->size + len + 1);
-  memcpy(&row->characters[row->size], s, len);
-  row->size += len;
-  row->characters[row->size] = '\0';
-  editorUpdateRow(row);
+void editorRowAppendString(erow *row, const char *s, size_t len) {
+  if (E.undo.recording) editorRecord(UNDO_INSERT_TEXT, bufferIndexOf(&E.rows, row), row->size, 0, s, len);
+  rowInsert(row, row->size, s, len);
+  editorUpdateRowRange(row, row->size - (int) len, 0, len);
   E.dirty++;
 }
 
 void editorRowDelChar(erow *row, int at) {
   if (at < 0 || at >= row->size) return;
-  memmove(&row->characters[at], &row->characters[at + 1], row->size - at);
-  row->size--;
-  editorUpdateRow(row);
+  if (E.undo.recording) {
+    char ch = rowCharAt(row, at);
+    editorRecordKey(UNDO_DELETE_TEXT, bufferIndexOf(&E.rows, row), at, ch);
+  }
+  rowDelete(row, at, 1);
+  editorUpdateRowRange(row, at, 1, 0);
   E.dirty++;
 }
 
+// 结束一次编辑对应的撤销步骤；步骤过大而无法记录时提示用户。
+void editorEndEdit() {
+  if (undoEnd(&E.undo, E.file_position_y, E.file_position_x))
+    editorSetStatusMessage("Edit too large to undo, undo history cleared");
+}
+
 void editorInsertChar(int c) {
+  editorLoadFinish();
+  undoBegin(&E.undo, E.file_position_y, E.file_position_x);
   if (E.file_position_y == E.number_of_rows) {
     editorInsertRow(E.number_of_rows, "", 0);
   }
-  editorRowInsertChar(&E.row[E.file_position_y], E.file_position_x, c);
+  editorRowInsertChar(editorRow(E.file_position_y), E.file_position_x, c);
   E.file_position_x++;
+  editorEndEdit();
 }
 
 void editorInsertNewline() {
+  editorLoadFinish();
+  undoBegin(&E.undo, E.file_position_y, E.file_position_x);
   if (E.file_position_x == 0) {
     editorInsertRow(E.file_position_y, "", 0);
   } else {
-    erow *row = &E.row[E.file_position_y];
-    editorInsertRow(E.file_position_y + 1, &row->characters[E.file_position_x], row->size - E.file_position_x);
-    row = &E.row[E.file_position_y];
-    row->size = E.file_position_x;
-    row->characters[row->size] = '\0';
-    editorUpdateRow(row);
+    // 树中节点地址稳定，插入新行后 row 依然有效。
+    erow *row = editorRow(E.file_position_y);
+    const char *text = rowText(row);
+    int tail_len = row->size - E.file_position_x;
+    editorInsertRow(E.file_position_y + 1, &text[E.file_position_x], tail_len);
+    if (tail_len > 0)
+      editorRecord(UNDO_DELETE_TEXT, E.file_position_y, E.file_position_x, 0, &text[E.file_position_x], tail_len);
+    rowDelete(row, E.file_position_x, tail_len);
+    editorUpdateRowRange(row, E.file_position_x, tail_len, 0);
   }
   E.file_position_y++;
   E.file_position_x = 0;
+  editorEndEdit();
+}
+
+// 在光标处插入一段可能跨越多行的文本（粘贴）。先数出换行数，
+// 再用 bufferInsertRows 一次插入所有新行，每行的内容只复制一次。
+// "\r\n"、"\r" 与 "\n" 都视为换行。
+void editorInsertText(const char *s, size_t len) {
+  if (len == 0)
+    return;
+  editorLoadFinish();
+  undoBegin(&E.undo, E.file_position_y, E.file_position_x);
+  if (E.file_position_y == E.number_of_rows)
+    editorInsertRow(E.number_of_rows, "", 0);
+
+  size_t lines = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] != '\n' && s[i] != '\r')
+      continue;
+    lines++;
+    if (s[i] == '\r' && i + 1 < len && s[i + 1] == '\n')
+      i++;
+  }
+
+  erow *row = editorRow(E.file_position_y);
+  E.dirty++;
+  if (lines == 0) {
+    editorRecord(UNDO_INSERT_TEXT, E.file_position_y, E.file_position_x, 0, s, len);
+    rowInsert(row, E.file_position_x, s, len);
+    editorUpdateRowRange(row, E.file_position_x, 0, len);
+    E.file_position_x += len;
+    editorEndEdit();
+    return;
+  }
+
+  // 光标之后的内容移到粘贴的最后一行末尾。
+  int tail_len = row->size - E.file_position_x;
+  char *tail = malloc(tail_len ? tail_len : 1);
+  if (tail == NULL)
+    die("malloc");
+  memcpy(tail, &rowText(row)[E.file_position_x], tail_len);
+  if (tail_len > 0)
+    editorRecord(UNDO_DELETE_TEXT, E.file_position_y, E.file_position_x, 0, tail, tail_len);
+  rowDelete(row, E.file_position_x, tail_len);
+
+  erow **rows = malloc(sizeof(erow *) * lines);
+  if (rows == NULL)
+    die("malloc");
+  bufferInsertRows(&E.rows, E.file_position_y + 1, lines, rows);
+
+  // 第一段接在光标处，其余各段依次填入新行。
+  size_t start = 0;
+  size_t k = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] != '\n' && s[i] != '\r')
+      continue;
+    if (k == 0) {
+      editorRecord(UNDO_INSERT_TEXT, E.file_position_y, E.file_position_x, 0, &s[start], i - start);
+      rowInsert(row, E.file_position_x, &s[start], i - start);
+    } else
+      rowInit(rows[k - 1], &s[start], i - start);
+    k++;
+    if (s[i] == '\r' && i + 1 < len && s[i + 1] == '\n')
+      i++;
+    start = i + 1;
+  }
+  erow *last = rows[lines - 1];
+  rowInit(last, &s[start], len - start);
+  rowInsert(last, last->size, tail, tail_len);
+  editorUpdateRow(row);
+
+  // 新行整体记为一条记录，各行内容以 '\n' 分隔。
+  size_t total = lines - 1;
+  for (size_t k = 0; k < lines; k++)
+    total += rows[k]->size;
+  char *text = undoRecord(&E.undo, UNDO_INSERT_ROWS, E.file_position_y + 1, 0, lines, total, 0);
+  for (size_t k = 0; text && k < lines; k++) {
+    memcpy(text, rowText(rows[k]), rows[k]->size);
+    text += rows[k]->size;
+    if (k + 1 < lines) *text++ = '\n';
+  }
+
+  E.number_of_rows += lines;
+  E.file_position_y += lines;
+  E.file_position_x = len - start;
+  free(rows);
+  free(tail);
+  editorEndEdit();
 }
 
 void editorDelChar() {
+  editorLoadFinish();
   if (E.file_position_y == E.number_of_rows) return;
   if (E.file_position_x == 0 && E.file_position_y == 0) return;
 
-  erow *row = &E.row[E.file_position_y];
+  undoBegin(&E.undo, E.file_position_y, E.file_position_x);
+  erow *row = editorRow(E.file_position_y);
   if (E.file_position_x > 0) {
     editorRowDelChar(row, E.file_position_x - 1);
     E.file_position_x--;
   } else {
-    E.file_position_x = E.row[E.file_position_y - 1].size;
-    editorRowAppendString(&E.row[E.file_position_y - 1], row->characters, row->size);
+    erow *prev = editorRow(E.file_position_y - 1);
+    E.file_position_x = prev->size;
+    editorRowAppendString(prev, rowText(row), row->size);
     editorDelRow(E.file_position_y);
     E.file_position_y--;
   }
+  editorEndEdit();
+}
+
+// 按撤销记录恢复从第 y 行起的 count 行，text 中各行以 '\n' 分隔。
+void editorRestoreRows(int y, int count, const char *text, size_t len) {
+  erow **rows = malloc(sizeof(erow *) * count);
+  if (rows == NULL)
+    die("malloc");
+  bufferInsertRows(&E.rows, y, count, rows);
+  const char *end = text + len;
+  for (int k = 0; k < count; k++) {
+    const char *newline = k + 1 < count ? memchr(text, '\n', end - text) : end;
+    rowInit(rows[k], text, newline - text);
+    text = newline + 1;
+  }
+  E.number_of_rows += count;
+  free(rows);
+}
+
+// 应用一条撤销记录：redo 为真时重做其修改，否则撤销。
+void editorApplyRecord(const struct undoRecord *r, int redo) {
+  const char *text = undoText(r);
+  int insert = (r->type == UNDO_INSERT_TEXT || r->type == UNDO_INSERT_ROWS) == redo;
+  switch (r->type) {
+    case UNDO_INSERT_TEXT:
+    case UNDO_DELETE_TEXT:
+      {
+        erow *row = editorRow(r->y);
+        if (insert)
+          rowInsert(row, r->x, text, r->len);
+        else
+          rowDelete(row, r->x, r->len);
+        editorUpdateRowRange(row, r->x, insert ? 0 : r->len, insert ? r->len : 0);
+      }
+      break;
+
+    case UNDO_INSERT_ROWS:
+    case UNDO_DELETE_ROW:
+      if (insert) {
+        editorRestoreRows(r->y, r->count, text, r->len);
+      } else {
+        bufferDeleteRows(&E.rows, r->y, r->count, editorFreeRow);
+        E.number_of_rows -= r->count;
+      }
+      break;
+  }
+  E.dirty++;
+}
+
+// 撤销最近一个步骤：逐条反向应用其记录，光标回到步骤开始前的位置。
+void editorUndo() {
+  editorLoadFinish();
+  const struct undoRecord *r;
+  while ((r = undoBack(&E.undo)) != NULL) {
+    editorApplyRecord(r, 0);
+    if (r->step) break;
+  }
+  if (r == NULL) {
+    editorSetStatusMessage("Nothing to undo");
+    return;
+  }
+  E.file_position_y = r->before_y;
+  E.file_position_x = r->before_x;
+}
+
+// 重做最近撤销的步骤，光标移到步骤结束后的位置。
+void editorRedo() {
+  editorLoadFinish();
+  const struct undoRecord *first = undoForward(&E.undo, 0);
+  if (first == NULL) {
+    editorSetStatusMessage("Nothing to redo");
+    return;
+  }
+  editorApplyRecord(first, 1);
+  const struct undoRecord *r;
+  while ((r = undoForward(&E.undo, 1)) != NULL)
+    editorApplyRecord(r, 1);
+  E.file_position_y = first->after_y;
+  E.file_position_x = first->after_x;
+}
+
+// 按行索引在末尾追加映射行：每个换行符结束从 load_line_start 开始的一行。
+// 跨越块边界的行自然由前一块的剩余部分与后一块的第一个换行符拼成。
+void editorAppendMappedLines(const struct lineIndex *index) {
+  if (index->count == 0)
+    return;
+  erow **rows = malloc(sizeof(erow *) * index->count);
+  if (rows == NULL)
+    die("malloc");
+  bufferInsertRows(&E.rows, E.number_of_rows, index->count, rows);
+
+  size_t start = E.load_line_start;
+  for (size_t j = 0; j < index->count; j++) {
+    size_t linelen = index->newlines[j] - start;
+    while (linelen > 0 && E.map[start + linelen - 1] == '\r')
+      linelen--;
+    rowInitMapped(rows[j], &E.map[start], linelen);
+    start = index->newlines[j] + 1;
+  }
+  E.load_line_start = start;
+  E.number_of_rows += index->count;
+  free(rows);
+}
+
+// 文件最后一行若没有换行符结尾，在全部索引拼接完后补上。
+void editorAppendMappedTail() {
+  size_t linelen = E.map_size - E.load_line_start;
+  if (linelen == 0)
+    return;
+  while (linelen > 0 && E.map[E.load_line_start + linelen - 1] == '\r')
+    linelen--;
+  erow *row = bufferInsert(&E.rows, E.number_of_rows);
+  rowInitMapped(row, &E.map[E.load_line_start], linelen);
+  E.number_of_rows++;
+  E.load_line_start = E.map_size;
 }
 
-char *editorRowsToString(int *buflen) {
-  int totlen = 0;
-  int j;
-  for (j = 0; j < E.number_of_rows; j++)
-    totlen += E.row[j].size + 1;
-  *buflen = totlen;
+// 取出并行加载器中已完成的块并追加成行，返回是否有新行。
+// wait 非零时一直等到整个文件加载完毕。
+int editorLoadPoll(int wait) {
+  if (E.loader.chunks == NULL)
+    return 0;
 
-  char *buf = malloc(totlen);
-  char *p = buf;
-  for (j = 0; j < E.number_of_rows; j++) {
-    memcpy(p, E.row[j].characters, E.row[j].size);
-    p += E.row[j].size;
-    *p = '\n';
-    p++;
+  int appended = 0;
+  struct loadChunk *chunk;
+  while ((chunk = loaderNext(&E.loader, wait)) != NULL) {
+    editorAppendMappedLines(&chunk->index);
+    lineIndexFree(&chunk->index);
+    appended = 1;
+  }
+  if (!loaderPending(&E.loader)) {
+    editorAppendMappedTail();
+    loaderFinish(&E.loader);
+    appended = 1;
   }
+  return appended;
+}
 
-  return buf;
+// 修改或保存前必须等待加载完成，保证行号与文件末尾都是最终结果。
+void editorLoadFinish() {
+  editorLoadPoll(1);
 }
 
+// 把文件整体映射进内存，每行直接指向映射中的文本，不做复制。
+// 无法映射（管道、空文件等）时返回 -1，由调用者退回逐行读取。
+int editorOpenMapped(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    return -1;
+
+  char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    return -1;
+  E.map = map;
+  E.map_size = st.st_size;
+
+  E.load_line_start = 0;
+  if ((size_t) st.st_size >= TEXOR_PARALLEL_LOAD_MIN) {
+    // 大文件交给并行加载器：只等第一块拼接完就返回，先显示首屏，
+    // 其余块在等待按键时陆续拼接。
+    loaderStart(&E.loader, map, st.st_size, TEXOR_LOAD_CHUNK_SIZE);
+    struct loadChunk *first = loaderNext(&E.loader, 1);
+    editorAppendMappedLines(&first->index);
+    lineIndexFree(&first->index);
+    return 0;
+  }
+
+  // 先对整个映射批量建立行索引，再按索引一次性创建映射行。
+  struct lineIndex index;
+  lineIndexInit(&index);
+  lineIndexScan(&index, map, st.st_size, 0);
+  editorAppendMappedLines(&index);
+  editorAppendMappedTail();
+  lineIndexFree(&index);
+  return 0;
+}
 
 void editorOpen(char *filename) {
   free(E.filename);
   E.filename = strdup(filename);
 
-  FILE *fp = fopen(filename, "r");
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    die("open");
+  if (editorOpenMapped(fd) == 0) {
+    close(fd);
+    E.dirty = 0;
+    return;
+  }
+
+  FILE *fp = fdopen(fd, "r");
   if (!fp)
-    die("fopen");
+    die("fdopen");
 
   char *line = NULL;
   size_t linecap = 0;
@@ -327,31 +552,24 @@ void editorOpen(char *filename) {
   E.dirty = 0;
 }
 
+// 保存到 filename（见 saveFile），并在消息栏报告结果。
+void editorSaveFile(const char *filename) {
+  long long len = saveFile(&E.rows, filename, TEXOR_SAVE_FSYNC);
+  if (len != -1) {
+    E.dirty = 0;
+    editorSetStatusMessage("%lld bytes written to disk", len);
+  } else {
+    editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+  }
+}
+
 void editorSave() {
+  editorLoadFinish();
   if (E.filename == NULL) {
     editorSaveAs();
     return;
   }
-
-  int len;
-  char *buf = editorRowsToString(&len);
-
-  int fd = open(E.filename, O_RDWR | O_CREAT, 0644);
-  if (fd != -1) {
-    if (ftruncate(fd, len) != -1) {
-      if (write(fd, buf, len) == len) {
-        close(fd);
-        free(buf);
-        E.dirty = 0;
-        editorSetStatusMessage("%d bytes written to disk", len);
-        return;
-      }
-    }
-    close(fd);
-  }
-
-  free(buf);
-  editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+  editorSaveFile(E.filename);
 }
 
 
@@ -364,48 +582,8 @@ void editorSaveAs() {
 
   free(E.filename);
   E.filename = filename;
-
-  int len;
-  char *buf = editorRowsToString(&len);
-
-  int fd = open(E.filename, O_RDWR | O_CREAT, 0644);
-  if (fd != -1) {
-    if (ftruncate(fd, len) != -1) {
-      if (write(fd, buf, len) == len) {
-        close(fd);
-        free(buf);
-        E.dirty = 0;
-        editorSetStatusMessage("%d bytes written to disk", len);
-        return;
-      }
-    }
-    close(fd);
-  }
-
-  free(buf);
-  editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
-}
-
-
-
-struct abuf {
-  char *b;
-  int len;
-};
-
-#define ABUF_INIT {NULL, 0}
-
-void abAppend(struct abuf *ab, const char *s, int len) {
-  char *new = realloc(ab->b, ab->len + len);
-  if (new == NULL)
-    return;
-  memcpy(&new[ab->len], s, len);
-  ab->b = new;
-  ab->len += len;
-}
-
-void abFree(struct abuf *ab) {
-  free(ab->b);
+  editorLoadFinish();
+  editorSaveFile(E.filename);
 }
 
 
@@ -415,7 +593,7 @@ void editorScroll() {
   E.screen_position_x = 0; // 初始化光标的屏幕x坐标。
   if (E.file_position_y < E.number_of_rows) { // 确保光标在文件内。
     // 计算光标的实际屏幕列位置。
-    E.screen_position_x = editorRowFilePositionXToScreenPositionX(&E.row[E.file_position_y], E.file_position_x);
+    E.screen_position_x = editorRowFilePositionXToScreenPositionX(editorRow(E.file_position_y), E.file_position_x);
   }
 
   // 垂直滚动检查
@@ -435,7 +613,7 @@ void editorScroll() {
   }
 }
 
-void editorDrawRows(struct abuf *ab) {
+void editorDrawRows() {
   for (int y = 0; y < E.screen_rows; y++) {
     int filerow = y + E.row_offset; // 计算当前屏幕行对应的文件行号。
     if (filerow >= E.number_of_rows) {
@@ -450,90 +628,79 @@ void editorDrawRows(struct abuf *ab) {
           welcomelen = E.screen_columns; // 截断过长的信息。
         int padding = (E.screen_columns - welcomelen) / 2; // 计算居中所需的左边距。
         if (padding) {
-          abAppend(ab, "~", 1); // 在行首添加一个 '~'。
+          screenPut(y, "~", 1); // 在行首添加一个 '~'。
           padding--;
         }
-        while (padding--) abAppend(ab, " ", 1); // 添加左边距空格。
-        abAppend(ab, welcome, welcomelen); // 添加欢迎信息。
+        while (padding--) screenPut(y, " ", 1); // 添加左边距空格。
+        screenPut(y, welcome, welcomelen); // 添加欢迎信息。
       } else {
         // 在其他超出文件内容的行首，只显示一个 '~'。
-        abAppend(ab, "~", 1);
+        screenPut(y, "~", 1);
       }
     } else {
       // 正常文件行
-      int len = E.row[filerow].rendered_size - E.column_offset; // 计算渲染后字符串长度。
-      if (len < 0)
-        len = 0;
-      if (len > E.screen_columns)
-        len = E.screen_columns;
-      // 从渲染字符串的 `column_offset` 位置开始，追加 `len` 个字符到缓冲区。
-      abAppend(ab, &E.row[filerow].rendered_characters[E.column_offset], len);
+      // 只有绘制到的行才会被渲染，结果保存在有界的渲染缓存中。
+      // 只取从 `column_offset` 开始、一屏宽的部分，长行不必整行展开。
+      int len;
+      const char *rendered = renderRow(editorRow(filerow), E.column_offset, E.screen_columns, &len);
+      if (len > 0)
+        screenPut(y, rendered, len);
     }
-    abAppend(ab, "\x1b[K", 3); // 清除光标到行尾，确保旧内容被清除。
-    abAppend(ab, "\r\n", 2);   // 回车和换行符，移动到下一行行首。
   }
 }
 
 
-void editorDrawStatusBar(struct abuf *ab) {
-  abAppend(ab, "\x1b[7m", 4);
+void editorDrawStatusBar() {
+  int y = E.screen_rows; // 状态栏位于文本区下方，整行反色显示。
+  screenSetInverse(y);
   char status[80], rstatus[80];
 
   // 格式化左侧状态信息：文件名 - 行数 (modified)。
   int len = snprintf(status, sizeof(status), "%.20s - %d lines %s",
       E.filename ? E.filename : "[No Name]", E.number_of_rows,
-      E.dirty ? "(modified)" : "");
+      E.dirty ? "(modified)" : loaderPending(&E.loader) ? "(loading...)" : "");
   // 格式化右侧状态信息：当前行/总行数。
   int rlen = snprintf(rstatus, sizeof(rstatus), "%d/%d",
       E.file_position_y + 1, E.number_of_rows);
 
   if (len > E.screen_columns)
     len = E.screen_columns; // 截断左侧信息。
-  abAppend(ab, status, len);
+  screenPut(y, status, len);
   // 填充空格，右对齐。
   while (len < E.screen_columns) {
     if (E.screen_columns - len == rlen) {
-      abAppend(ab, rstatus, rlen); // 追加右侧信息。
+      screenPut(y, rstatus, rlen); // 追加右侧信息。
       break;
     } else {
-      abAppend(ab, " ", 1); // 填充空格。
+      screenPut(y, " ", 1); // 填充空格。
       len++;
     }
   }
-  abAppend(ab, "\x1b[m", 3); //VT100 "关闭所有文本属性" ，恢复正常显示。
-  abAppend(ab, "\r\n", 2); // 换行。
 }
 
 
-void editorDrawMessageBar(struct abuf *ab) {
-  abAppend(ab, "\x1b[K", 3); // 清除整行。
+void editorDrawMessageBar() {
+  int y = E.screen_rows + 1;
   int msglen = strlen(E.status_message); // 获取消息长度。
   if (msglen > E.screen_columns)
     msglen = E.screen_columns; // 截断消息。
-  // 消息不为空，且距离设置时间不到5秒
-  if (msglen && time(NULL) - E.status_message_time < 5)
-    abAppend(ab, E.status_message, msglen);
+  // 消息不为空，且正在输入提示或距离设置时间不到 TEXOR_MESSAGE_SECONDS 秒
+  if (msglen && (E.prompting || time(NULL) - E.status_message_time < TEXOR_MESSAGE_SECONDS))
+    screenPut(y, E.status_message, msglen);
 }
 
+// 把各部分绘制到新帧，再只输出与上一帧不同的部分。
 void editorRefreshScreen() {
   editorScroll();
-  struct abuf ab = ABUF_INIT;
-
-  abAppend(&ab, "\x1b[?25l", 6); //  隐藏光标，防止刷新时屏幕闪烁。
-  abAppend(&ab, "\x1b[H", 3);    //  光标归位，将光标移动到屏幕左上角(1,1)。
 
-  editorDrawRows(&ab);
-  editorDrawStatusBar(&ab);
-  editorDrawMessageBar(&ab);
+  screenBegin();
+  editorDrawRows();
+  editorDrawStatusBar();
+  editorDrawMessageBar();
 
-  // 格式化 "移动光标" 序列，将其移动到正确的编辑位置。
-  char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.file_position_y - E.row_offset) + 1, (E.screen_position_x - E.column_offset) + 1);
-  abAppend(&ab, buf, strlen(buf)); // 将该序列追加到缓冲区。
-  abAppend(&ab, "\x1b[?25h", 6); // 追加 "显示光标" 序列。
-
-  write(STDOUT_FILENO, ab.b, ab.len);
-  abFree(&ab);
+  int len;
+  const char *out = screenFlush(E.file_position_y - E.row_offset, E.screen_position_x - E.column_offset, &len);
+  if (len > 0) write(STDOUT_FILENO, out, len);
 }
 
 
@@ -546,6 +713,84 @@ void editorSetStatusMessage(const char *fmt, ...) {
   E.status_message_time = time(NULL); // 记录消息设置时间
 }
 
+// 状态消息还要显示多少毫秒；没有会到期的消息时返回 -1。
+int editorMessageTimeout() {
+  if (E.status_message[0] == '\0' || E.prompting)
+    return -1;
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  long long expire = (long long) (E.status_message_time + TEXOR_MESSAGE_SECONDS) * 1000;
+  long long left = expire - ((long long) now.tv_sec * 1000 + now.tv_nsec / 1000000);
+  return left > 0 ? (int) left : -1;
+}
+
+void editorHandleWinch(int sig) {
+  (void) sig;
+  int saved_errno = errno;
+  write(resize_pipe[1], "", 1);
+  errno = saved_errno;
+}
+
+// 窗口大小改变：重新取得尺寸，整屏重绘。
+void editorResize() {
+  char drain[64];
+  while (read(resize_pipe[0], drain, sizeof(drain)) > 0) {}
+  if (getWindowSize(&E.screen_rows, &E.screen_columns) == -1) die("getWindowSize");
+  E.screen_rows -= 2;
+  if (E.screen_rows < 1)
+    E.screen_rows = 1;
+  screenResize(E.screen_rows + 2, E.screen_columns);
+  editorRefreshScreen();
+}
+
+// 终端已关闭，不会再有输入：清屏后正常退出，由 atexit 恢复终端设置。这不是读取错误。
+void editorHangup() {
+  write(STDOUT_FILENO, "\x1b[2J", 4);
+  write(STDOUT_FILENO, "\x1b[H", 3);
+  exit(0);
+}
+
+// 事件循环的一次等待：睡眠到终端输入、窗口大小变化、后台加载进度、
+// 转义序列超时或状态消息到期之一发生。空闲时不会周期性唤醒。
+void editorWaitForEvent() {
+  struct pollfd fds[3];
+  int count = 0;
+  fds[count++] = (struct pollfd) {STDIN_FILENO, POLLIN, 0};
+  fds[count++] = (struct pollfd) {resize_pipe[0], POLLIN, 0};
+  int loading = loaderPending(&E.loader);
+  if (loading)
+    fds[count++] = (struct pollfd) {E.loader.notify[0], POLLIN, 0};
+
+  int timeout = inputIncomplete() ? TEXOR_ESCAPE_TIMEOUT_MS : editorMessageTimeout();
+  int ready = poll(fds, count, timeout);
+  if (ready == -1) {
+    if (errno == EINTR)
+      return;
+    die("poll");
+  }
+  if (ready == 0) {
+    if (inputIncomplete())
+      inputFlushEscape();
+    else
+      editorRefreshScreen(); // 状态消息到期，重绘消息栏。
+    return;
+  }
+
+  if (fds[1].revents & POLLIN)
+    editorResize();
+  if (loading && (fds[2].revents & POLLIN)) {
+    // 拼接后台加载完成的块，有新行时刷新屏幕。
+    char drain[64];
+    while (read(E.loader.notify[0], drain, sizeof(drain)) > 0) {}
+    if (editorLoadPoll(0))
+      editorRefreshScreen();
+  }
+  if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+    if (inputRead() == 0)
+      editorHangup();
+  }
+}
+
 
 char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
   size_t bufsize = INPUT_BUFSIZE;
@@ -553,16 +798,22 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
 
   size_t buflen = 0; // 当前输入长度。
   buf[0] = '\0';
+  E.prompting = 1;
   while(1) {
 
     editorSetStatusMessage(prompt, buf);
-    editorRefreshScreen();
+    // 还有已到达的按键时先处理完，再刷新屏幕。
+    if (inputPending())
+      editorScroll();
+    else
+      editorRefreshScreen();
 
     int c = editorReadKey(); // 读取
     // 处理退格/删除
     if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
       if (buflen != 0) buf[--buflen] = '\0';
     } else if (c == '\x1b') { // Esc取消输入。
+      E.prompting = 0;
       editorSetStatusMessage(""); // 清空消息栏
       if (callback)
         callback(buf, c); // 执行可选的回调
@@ -570,11 +821,26 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
       return NULL; // 返回NULL表示取消。
     } else if (c == '\r') { // 回车键确认
       if (buflen != 0) {
+        E.prompting = 0;
         editorSetStatusMessage("");
         if (callback)
           callback(buf, c);
         return buf;
       }
+    } else if (c == PASTE_KEY) { // 粘贴到提示框：只保留可打印字符。
+      size_t len;
+      char *text = inputTakePaste(&len);
+      for (size_t i = 0; i < len; i++) {
+        if (iscntrl((unsigned char) text[i]) || (unsigned char) text[i] >= 128)
+          continue;
+        if (buflen == bufsize - 1) {
+          bufsize *= 2;
+          buf = realloc(buf, bufsize);
+        }
+        buf[buflen++] = text[i];
+      }
+      buf[buflen] = '\0';
+      free(text);
     } else if (!iscntrl(c) && c < 128) { // 普通可打印字符
       if (buflen == bufsize - 1) {
         bufsize *= 2;
@@ -591,14 +857,14 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
 // 根据按键 `key` 移动光标。
 void editorMoveCursor(int key) {
   // 获取当前光标所在行的指针，如果光标在文件外则为NULL。
-  erow *row = (E.file_position_y >= E.number_of_rows) ? NULL : &E.row[E.file_position_y];
+  erow *row = (E.file_position_y >= E.number_of_rows) ? NULL : editorRow(E.file_position_y);
   switch (key) {
     case ARROW_LEFT:
       if (E.file_position_x != 0) { // 如果不在行首。
         E.file_position_x--; // 光标左移。
       } else if (E.file_position_y > 0) { // 如果在行首且不在第一行。
         E.file_position_y--; // 移动到上一行。
-        E.file_position_x = E.row[E.file_position_y].size; // 移动到上一行的行尾。
+        E.file_position_x = editorRow(E.file_position_y)->size; // 移动到上一行的行尾。
       }
       break;
     case ARROW_RIGHT:
@@ -617,16 +883,15 @@ void editorMoveCursor(int key) {
       break;
   }
   // 修正光标位置：如果光标移动到新一行后，其x坐标超出了新行的长度，则将其x坐标调整为新行的行尾。
-  row = (E.file_position_y >= E.number_of_rows) ? NULL : &E.row[E.file_position_y];
+  row = (E.file_position_y >= E.number_of_rows) ? NULL : editorRow(E.file_position_y);
   int rowlen = row ? row->size : 0;
   if (E.file_position_x > rowlen) {
     E.file_position_x = rowlen;
   }
 }
 
-void editorProcessKeypress() {
+void editorProcessKey(int c) {
   static int quit_times = TEXOR_QUIT_TIMES; // 退出确认的次数
-  int c = editorReadKey();
 
   switch (c) {
     case '\r':
@@ -654,13 +919,21 @@ void editorProcessKeypress() {
       editorSave();
       break;
 
+    case CTRL_KEY('z'): // Ctrl-Z，撤销
+      editorUndo();
+      break;
+
+    case CTRL_KEY('y'): // Ctrl-Y，重做
+      editorRedo();
+      break;
+
     case HOME_KEY:
       E.file_position_x = 0; // 移动光标到行首。
       break;
 
     case END_KEY:
       if (E.file_position_y < E.number_of_rows)
-        E.file_position_x = E.row[E.file_position_y].size; // 移动光标到行尾。
+        E.file_position_x = editorRow(E.file_position_y)->size; // 移动光标到行尾。
       break;
 
     case BACKSPACE:
@@ -694,6 +967,15 @@ void editorProcessKeypress() {
       editorMoveCursor(c); // 光标移动
       break;
 
+    case PASTE_KEY:
+      {
+        size_t len;
+        char *text = inputTakePaste(&len);
+        editorInsertText(text, len); // 整段粘贴一次插入。
+        free(text);
+      }
+      break;
+
     case CTRL_KEY('l'):
     case '\x1b':
       break;
@@ -706,6 +988,16 @@ void editorProcessKeypress() {
   quit_times = TEXOR_QUIT_TIMES;
 }
 
+// 等待一个按键，然后把这次已到达的所有按键处理完，之后才刷新一次屏幕。
+// 翻页等操作依赖滚动偏移，因此每个按键之前仍要像刷新时一样先滚动。
+void editorProcessKeypress() {
+  editorProcessKey(editorReadKey());
+  while (inputPending()) {
+    editorScroll();
+    editorProcessKey(editorReadKey());
+  }
+}
+
 void initEditor() {
   E.file_position_x = 0;
   E.file_position_y = 0;
@@ -713,16 +1005,31 @@ void initEditor() {
   E.row_offset = 0;
   E.column_offset = 0;
   E.number_of_rows = 0;
-  E.row = NULL;
+  bufferInit(&E.rows);
   E.dirty = 0;
   E.filename = NULL;
+  E.map = NULL;
+  E.map_size = 0;
+  undoInit(&E.undo, TEXOR_UNDO_LIMIT);
   // 初始化消息栏。
   E.status_message[0] = '\0';
   E.status_message_time = 0;
+  E.prompting = 0;
   // 获取终端窗口大小。
   if (getWindowSize(&E.screen_rows, &E.screen_columns) == -1) die("getWindowSize");
   // 为状态栏和消息栏预留出底部的2行空间。
   E.screen_rows -= 2;
+  screenResize(E.screen_rows + 2, E.screen_columns);
+
+  if (pipe(resize_pipe) == -1) die("pipe");
+  fcntl(resize_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(resize_pipe[1], F_SETFL, O_NONBLOCK);
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = editorHandleWinch;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGWINCH, &sa, NULL) == -1) die("sigaction");
 }
 
 
@@ -736,7 +1043,7 @@ int main(int argc, char *argv[]) {
   }
 
   editorSetStatusMessage(
-      "HELP: Ctrl-S = save | Ctrl-A = save as | Ctrl-Q = quit");
+      "HELP: Ctrl-S = save | Ctrl-A = save as | Ctrl-Z/Y = undo/redo | Ctrl-Q = quit");
 
   while (1) {
     editorRefreshScreen();
@@ -0,0 +1,341 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "render.h"
+#include "terminal.h"
+
+
+// 渲染缓存的槽位数。只有屏幕上绘制到的行才会占用槽位，
+// 因此只需比最大屏幕行数宽裕即可。
+#define RENDER_CACHE_SLOTS 512
+// 槽位缓冲区超过此大小、而新内容又远小于它时，重新分配以归还内存。
+#define RENDER_SHRINK_LIMIT 65536
+// 不短于此长度的行按块渲染：只记录各块起点的屏幕列，绘制时只展开视口所在的块。
+// 两者均可在编译时覆盖，测试用很小的值让短行也经过分块的路径。
+#ifndef RENDER_LONG_ROW
+#define RENDER_LONG_ROW 65536
+#endif
+// 长行分块的大小。编辑后重新切分时，块长保持在它的一到两倍之间。
+#ifndef RENDER_CHUNK
+#define RENDER_CHUNK 4096
+#endif
+
+// 一个制表符在文件中的位置，以及展开后紧随其后的屏幕列。
+struct renderTab {
+  int file_x;
+  int screen_x;
+};
+
+// 长行中的一块：起点的文件位置与屏幕列，以及块内第一个制表符的偏移，-1 表示没有。
+struct renderChunk {
+  int file_x;
+  int screen_x;
+  int first_tab;
+};
+
+struct renderSlot {
+  erow *owner;        // 当前占用此槽位的行，NULL 表示空闲。
+  char *characters;   // 展开制表符后的内容；长行只存放最近一次绘制的可见部分。
+  int size;           // 整行展开后的宽度。
+  int direct;         // 行中没有制表符，渲染结果就是行本身的文本，不另行复制。
+  int capacity;
+  struct renderTab *tabs;   // 行中各制表符的位置，按顺序排列，用于列坐标换算。
+  int tab_count;
+  int tab_capacity;
+  struct renderChunk *chunks;   // 长行的各块，按位置排列；为 0 块时整行展开。
+  int chunk_count;
+  int chunk_capacity;
+  int referenced;     // 时钟置换算法的访问位。
+};
+
+static struct renderSlot slots[RENDER_CACHE_SLOTS];
+static int clock_hand = 0;
+
+// 时钟算法：跳过最近访问过的槽位，找到第一个可淘汰的槽位。
+static int evictSlot(void) {
+  while (1) {
+    struct renderSlot *slot = &slots[clock_hand];
+    int index = clock_hand;
+    clock_hand = (clock_hand + 1) % RENDER_CACHE_SLOTS;
+    if (slot->owner && slot->referenced) {
+      slot->referenced = 0;
+      continue;
+    }
+    if (slot->owner) slot->owner->render_slot = -1;
+    slot->owner = NULL;
+    return index;
+  }
+}
+
+// 保证缓冲区至少能容纳 needed 个大小为 size 的元素。
+// 缓冲区过大而需求又远小于它时，先释放以归还内存。
+static void *reserve(void *p, int *capacity, int needed, size_t size) {
+  if (*capacity * size > RENDER_SHRINK_LIMIT && needed * 4 < *capacity) {
+    free(p);
+    p = NULL;
+    *capacity = 0;
+  }
+  if (needed > *capacity) {
+    p = realloc(p, needed * size);
+    if (p == NULL) die("realloc");
+    *capacity = needed;
+  }
+  return p;
+}
+
+// 取得从逻辑位置 at 开始的一段连续文本，返回其长度。
+static int spanFrom(const erow *row, int at, const char **s) {
+  int len = rowSpan(row, 0, s);
+  if (at < len) {
+    *s += at;
+    return len - at;
+  }
+  len = rowSpan(row, 1, s);
+  *s += at - (row->size - len);
+  return row->size - at;
+}
+
+// 从屏幕列 column 起展开文件位置 [from, to) 的文本，返回其后的屏幕列。
+// 用 memchr 跳过制表符之间的文本。first_tab 非空时存入第一个制表符相对 from 的偏移。
+static int advance(const erow *row, int from, int to, int column, int *first_tab) {
+  if (first_tab) *first_tab = -1;
+  for (int at = from; at < to;) {
+    const char *s;
+    int len = spanFrom(row, at, &s);
+    if (len > to - at) len = to - at;
+    const char *end = s + len;
+    const char *tab;
+    while ((tab = memchr(s, '\t', end - s)) != NULL) {
+      if (first_tab && *first_tab < 0) *first_tab = at + (int) (tab - (end - len)) - from;
+      column += tab - s;
+      column += TEXOR_TAB_STOP - column % TEXOR_TAB_STOP;
+      s = tab + 1;
+    }
+    column += end - s;
+    at += len;
+  }
+  return column;
+}
+
+static int chunkCount(int len) {
+  return len >= 2 * RENDER_CHUNK ? len / RENDER_CHUNK : 1;
+}
+
+// 把文件位置 [from, to) 切成 chunkCount 块写入 out，余数并入最后一块。
+// column 为 from 处的屏幕列，返回 to 处的屏幕列。
+static int splitChunks(const erow *row, int from, int to, int column, struct renderChunk *out) {
+  int n = chunkCount(to - from);
+  for (int k = 0; k < n; k++) {
+    int end = k == n - 1 ? to : from + RENDER_CHUNK;
+    out[k].file_x = from;
+    out[k].screen_x = column;
+    column = advance(row, from, end, column, &out[k].first_tab);
+    from = end;
+  }
+  return column;
+}
+
+// 返回起点不超过 x 的最后一块；by_screen 非零时按屏幕列查找，否则按文件位置。
+static int chunkAt(const struct renderSlot *slot, int x, int by_screen) {
+  int low = 1, high = slot->chunk_count;
+  while (low < high) {
+    int middle = (low + high) / 2;
+    const struct renderChunk *c = &slot->chunks[middle];
+    if ((by_screen ? c->screen_x : c->file_x) <= x)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low - 1;
+}
+
+// 渲染一行，同时记下各制表符的位置。没有制表符且文本连续（映射行、内联行或间隙在行尾）时只记下这一事实，
+// 由 renderRow 直接返回行的文本；否则展开到槽位的缓冲区中。长行只切分成块并算出各块起点的列。
+static void renderInto(struct renderSlot *slot, erow *row) {
+  const char *s;
+  int len;
+  int tabs = 0;
+  int k, j;
+  slot->tab_count = 0;
+  slot->chunk_count = 0;
+  if (row->size >= RENDER_LONG_ROW) {
+    slot->direct = 0;
+    slot->chunks = reserve(slot->chunks, &slot->chunk_capacity, chunkCount(row->size), sizeof(struct renderChunk));
+    slot->chunk_count = chunkCount(row->size);
+    slot->size = splitChunks(row, 0, row->size, 0, slot->chunks);
+    return;
+  }
+
+  for (k = 0; (len = rowSpan(row, k, &s)) != -1; k++)
+    for (const char *t = s; (t = memchr(t, '\t', &s[len] - t)) != NULL; t++)
+      tabs++;
+
+  slot->direct = tabs == 0 && rowSpan(row, 0, &s) == row->size;
+  slot->size = row->size;
+  if (slot->direct) return;
+
+  slot->characters = reserve(slot->characters, &slot->capacity,
+                             row->size + tabs * (TEXOR_TAB_STOP - 1) + 1, 1);
+  slot->tabs = reserve(slot->tabs, &slot->tab_capacity, tabs, sizeof(struct renderTab));
+
+  int index = 0;
+  int file_x = 0;
+  for (k = 0; (len = rowSpan(row, k, &s)) != -1; k++) {
+    for (j = 0; j < len; j++, file_x++) {
+      if (s[j] == '\t') {
+        slot->characters[index++] = ' ';
+        while (index % TEXOR_TAB_STOP != 0) slot->characters[index++] = ' ';
+        slot->tabs[slot->tab_count++] = (struct renderTab) {file_x, index};
+      } else {
+        slot->characters[index++] = s[j];
+      }
+    }
+  }
+  slot->characters[index] = '\0';
+  slot->size = index;
+}
+
+// 返回行所在的槽位，未命中缓存时才进行渲染。
+static struct renderSlot *lookup(erow *row) {
+  struct renderSlot *slot;
+  if (row->render_slot >= 0 && slots[row->render_slot].owner == row) {
+    slot = &slots[row->render_slot];
+  } else {
+    row->render_slot = evictSlot();
+    slot = &slots[row->render_slot];
+    slot->owner = row;
+    renderInto(slot, row);
+  }
+  slot->referenced = 1;
+  return slot;
+}
+
+// 展开长行中屏幕列 [column, column + width) 的部分：从视口左端所在的块起逐字节推进，
+// 到视口右端为止，不触及行中其余的块。
+static const char *renderWindow(struct renderSlot *slot, erow *row, int column, int width, int *len) {
+  slot->characters = reserve(slot->characters, &slot->capacity, width + 1, 1);
+  struct renderChunk *c = &slot->chunks[chunkAt(slot, column, 1)];
+  int at = c->file_x;
+  int x = c->screen_x;
+  int n = 0;
+  while (at < row->size && x < column + width) {
+    const char *s;
+    int span = spanFrom(row, at, &s);
+    for (int j = 0; j < span && x < column + width; j++, at++) {
+      if (s[j] == '\t') {
+        do {
+          if (x >= column && x < column + width) slot->characters[n++] = ' ';
+          x++;
+        } while (x % TEXOR_TAB_STOP != 0);
+      } else {
+        if (x >= column) slot->characters[n++] = s[j];
+        x++;
+      }
+    }
+  }
+  *len = n;
+  return slot->characters;
+}
+
+// 返回行展开制表符后位于屏幕列 [column, column + width) 的内容，len 为其长度。
+// 返回的指针在下一次调用 renderRow 或修改该行之前有效。
+const char *renderRow(erow *row, int column, int width, int *len) {
+  struct renderSlot *slot = lookup(row);
+  if (slot->chunk_count) return renderWindow(slot, row, column, width, len);
+
+  const char *s = slot->characters;
+  // 内容未变但间隙可能已被移开，文本不再连续时改为复制。
+  if (slot->direct && rowSpan(row, 0, &s) != row->size) {
+    renderInto(slot, row);
+    s = slot->characters;
+  }
+  int n = slot->size - column;
+  if (n < 0) n = 0;
+  if (n > width) n = width;
+  *len = n;
+  return n > 0 ? &s[column] : s;
+}
+
+// 文件列 file_x 之前的内容展开后的宽度，即该位置的屏幕列。
+// 在渲染时记下的制表符位置中二分查找，无需从行首逐个字符累加。
+int renderColumn(erow *row, int file_x) {
+  struct renderSlot *slot = lookup(row);
+  if (file_x > row->size) file_x = row->size;
+  if (slot->chunk_count) {
+    // 长行从所在块的起点推进，至多扫过一块。
+    struct renderChunk *c = &slot->chunks[chunkAt(slot, file_x, 0)];
+    return advance(row, c->file_x, file_x, c->screen_x, NULL);
+  }
+  int low = 0, high = slot->tab_count;
+  while (low < high) {
+    int middle = (low + high) / 2;
+    if (slot->tabs[middle].file_x < file_x)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  // low 为 file_x 之前的制表符个数；最后一个之后的字符各占一列。
+  if (low == 0) return file_x;
+  struct renderTab *tab = &slot->tabs[low - 1];
+  return tab->screen_x + (file_x - tab->file_x - 1);
+}
+
+// 行内容改变或行被释放时调用，丢弃其缓存的渲染结果。
+void renderInvalidate(erow *row) {
+  if (row->render_slot >= 0 && slots[row->render_slot].owner == row)
+    slots[row->render_slot].owner = NULL;
+  row->render_slot = -1;
+}
+
+// 行在 at 处删去 removed 字节、插入 inserted 字节后调用。
+// 长行只重新切分并展开与修改相交的块，其后各块的起点随长度与列宽的变化平移；
+// 其余情况与 renderInvalidate 相同。
+void renderEdit(erow *row, int at, int removed, int inserted) {
+  if (row->render_slot < 0 || slots[row->render_slot].owner != row) {
+    row->render_slot = -1;
+    return;
+  }
+  struct renderSlot *slot = &slots[row->render_slot];
+  if (slot->chunk_count == 0 || row->size < RENDER_LONG_ROW) {
+    renderInvalidate(row);
+    return;
+  }
+
+  // 受影响的块为 [first, last)，位置均为修改前的坐标。
+  int delta = inserted - removed;
+  int count = slot->chunk_count;
+  int first = chunkAt(slot, at, 0);
+  int last = chunkAt(slot, at + removed, 0) + 1;
+  int end = last < count ? slot->chunks[last].file_x + delta : row->size;
+  // 区间过短时并入相邻的块，避免反复删除后留下大量碎块。
+  if (end - slot->chunks[first].file_x < RENDER_CHUNK) {
+    if (last < count)
+      last++;
+    else if (first > 0)
+      first--;
+    end = last < count ? slot->chunks[last].file_x + delta : row->size;
+  }
+  int from = slot->chunks[first].file_x;
+  int column = slot->chunks[first].screen_x;
+  int old_end = last < count ? slot->chunks[last].screen_x : slot->size;
+
+  int n = chunkCount(end - from);
+  slot->chunk_count = count - (last - first) + n;
+  if (slot->chunk_count > slot->chunk_capacity)
+    slot->chunks = reserve(slot->chunks, &slot->chunk_capacity, slot->chunk_count, sizeof(struct renderChunk));
+  memmove(&slot->chunks[first + n], &slot->chunks[last], (count - last) * sizeof(struct renderChunk));
+  int shift = splitChunks(row, from, end, column, &slot->chunks[first]) - old_end;
+
+  // 块内第一个制表符把列对齐到制表位，其后的平移量随之变为制表位的整数倍；
+  // 没有制表符的块整体平移，无需重新扫描。
+  for (int k = first + n; k < slot->chunk_count; k++) {
+    struct renderChunk *c = &slot->chunks[k];
+    c->file_x += delta;
+    c->screen_x += shift;
+    if (shift % TEXOR_TAB_STOP != 0 && c->first_tab >= 0) {
+      int before = c->screen_x + c->first_tab;
+      shift = (before / TEXOR_TAB_STOP - (before - shift) / TEXOR_TAB_STOP) * TEXOR_TAB_STOP;
+    }
+  }
+  slot->size += shift;
+}
@@ -0,0 +1,18 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "row.h"
+
+
+#define TEXOR_TAB_STOP 8
+
+const char *renderRow(erow *row, int column, int width, int *len);
+
+int renderColumn(erow *row, int file_x);
+
+void renderInvalidate(erow *row);
+
+void renderEdit(erow *row, int at, int removed, int inserted);
+
+
+#endif //RENDER_H
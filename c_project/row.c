@@ -0,0 +1,159 @@
+#include <string.h>
+
+#include "row.h"
+#include "slab.h"
+
+
+#define ROW_MIN_CAPACITY 16
+
+static int gapLength(const erow *row) {
+  return row->capacity - row->size;
+}
+
+// 将间隙移动到逻辑位置 at，只搬动间隙与 at 之间的文本。
+static void moveGap(erow *row, int at) {
+  int gaplen = gapLength(row);
+  if (at < row->gap) {
+    memmove(&row->characters[at + gaplen], &row->characters[at], row->gap - at);
+  } else if (at > row->gap) {
+    memmove(&row->characters[row->gap], &row->characters[row->gap + gaplen], at - row->gap);
+  }
+  row->gap = at;
+}
+
+// 保证间隙至少能容纳 len 个字节，容量按几何级数增长。
+static void reserveGap(erow *row, int len) {
+  if (gapLength(row) >= len) return;
+
+  int capacity = row->capacity * 2;
+  if (capacity < ROW_MIN_CAPACITY) capacity = ROW_MIN_CAPACITY;
+  if (capacity < row->size + len) capacity = row->size + len;
+  capacity = slabSize(capacity);
+
+  char *characters = slabRealloc(row->characters, row->capacity, capacity);
+
+  // 间隙之后的文本挪到新缓冲区末尾。
+  int tail = row->size - row->gap;
+  memmove(&characters[capacity - tail], &characters[row->capacity - tail], tail);
+  row->characters = characters;
+  row->capacity = capacity;
+}
+
+// 短行存放在行记录内部；其余的文本存放在分级分配器的块中，块内多出的部分直接作为间隙。
+void rowInit(erow *row, const char *s, int len) {
+  row->size = len;
+  row->render_slot = -1;
+  if (len <= ROW_INLINE_CAPACITY) {
+    memcpy(row->text, s, len);
+    row->storage = ROW_INLINE;
+    return;
+  }
+  row->capacity = slabSize(len);
+  row->gap = len;
+  row->characters = slabAlloc(row->capacity);
+  memcpy(row->characters, s, len);
+  row->storage = ROW_HEAP;
+}
+
+// 让行直接引用映射中的文本，不做任何复制。映射须在行的生命周期内有效。
+void rowInitMapped(erow *row, const char *s, int len) {
+  row->size = len;
+  row->capacity = len;
+  row->gap = len;
+  row->characters = (char *) s;
+  row->storage = ROW_MAPPED;
+  row->render_slot = -1;
+}
+
+// 写时复制：映射行在被修改前复制一份自有的存储。
+void rowDetach(erow *row) {
+  if (row->storage != ROW_MAPPED) return;
+  const char *s = row->characters;
+  int render_slot = row->render_slot;
+  rowInit(row, s, row->size);
+  row->render_slot = render_slot;
+}
+
+void rowFree(erow *row) {
+  if (row->storage == ROW_HEAP)
+    slabFree(row->characters, row->capacity);
+}
+
+char rowCharAt(const erow *row, int at) {
+  if (row->storage == ROW_INLINE) return row->text[at];
+  return at < row->gap ? row->characters[at] : row->characters[at + gapLength(row)];
+}
+
+// 第 index 段连续文本：0 为间隙前，1 为间隙后；返回其长度，不存在时返回 -1。
+int rowSpan(const erow *row, int index, const char **s) {
+  if (row->storage == ROW_INLINE) {
+    *s = row->text;
+    return index == 0 ? row->size : -1;
+  }
+  switch (index) {
+    case 0:
+      *s = row->characters;
+      return row->gap;
+    case 1:
+      *s = &row->characters[row->gap + gapLength(row)];
+      return row->size - row->gap;
+  }
+  return -1;
+}
+
+// 把间隙移到行尾，返回连续的行内容（长度为 size，不以 '\0' 结尾）。
+const char *rowText(erow *row) {
+  if (row->storage == ROW_INLINE) return row->text;
+  moveGap(row, row->size);
+  return row->characters;
+}
+
+// 内联行放不下插入的内容时转为间隙缓冲区，间隙紧跟在插入的文本之后。
+// 行记录中的文本与新字段共用空间，须先复制出来再改写字段。
+static void rowSpill(erow *row, int at, const char *s, int len) {
+  int capacity = slabSize(row->size + len > ROW_MIN_CAPACITY ? row->size + len : ROW_MIN_CAPACITY);
+  char *characters = slabAlloc(capacity);
+  int tail = row->size - at;
+  memcpy(characters, row->text, at);
+  memcpy(&characters[at], s, len);
+  memcpy(&characters[capacity - tail], &row->text[at], tail);
+  row->size += len;
+  row->capacity = capacity;
+  row->gap = at + len;
+  row->characters = characters;
+  row->storage = ROW_HEAP;
+}
+
+void rowInsert(erow *row, int at, const char *s, int len) {
+  if (at < 0 || at > row->size) at = row->size;
+  rowDetach(row);
+  if (row->storage == ROW_INLINE) {
+    if (row->size + len > ROW_INLINE_CAPACITY) {
+      rowSpill(row, at, s, len);
+      return;
+    }
+    memmove(&row->text[at + len], &row->text[at], row->size - at);
+    memcpy(&row->text[at], s, len);
+    row->size += len;
+    return;
+  }
+  reserveGap(row, len);
+  moveGap(row, at);
+  memcpy(&row->characters[row->gap], s, len);
+  row->gap += len;
+  row->size += len;
+}
+
+void rowDelete(erow *row, int at, int len) {
+  if (at < 0 || at >= row->size) return;
+  if (len > row->size - at) len = row->size - at;
+  rowDetach(row);
+  if (row->storage == ROW_INLINE) {
+    memmove(&row->text[at], &row->text[at + len], row->size - at - len);
+    row->size -= len;
+    return;
+  }
+  moveGap(row, at);
+  // 删除即扩大间隙：间隙起点不变，逻辑长度缩短。
+  row->size -= len;
+}
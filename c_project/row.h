@@ -0,0 +1,53 @@
+#ifndef ROW_H
+#define ROW_H
+
+
+enum rowStorage {
+  ROW_HEAP = 0,   // characters 为行自有的间隙缓冲区。
+  ROW_MAPPED,     // characters 直接指向只读的文件映射，首次修改时才复制到堆上。
+  ROW_INLINE      // 文本直接存放在行记录的 text 中，没有单独的分配。
+};
+
+// 不超过此长度的行采用内联存储。
+#define ROW_INLINE_CAPACITY 24
+
+// 单行文本采用间隙缓冲区（gap buffer）存储：
+// characters[0, gap) 为间隙前的文本，随后是长度为 capacity - size 的间隙，
+// 其后是剩余文本。在光标处连续插入、删除只需移动间隙，均摊 O(1)。
+// 映射行的间隙始终位于行尾且长度为 0，读取接口无需区分两种存储。
+// 短行的文本与间隙缓冲区的三个字段共用空间，连续存放在行记录内部，
+// erow 的大小不变；行增长到放不下时透明地转为间隙缓冲区。
+typedef struct erow {
+  int size;               // 行的逻辑长度（不含间隙）。
+  short render_slot;      // 渲染缓存中的槽位，-1 表示尚未渲染。
+  unsigned char storage;  // enum rowStorage
+  union {
+    struct {
+      int capacity;       // characters 的容量。
+      int gap;            // 间隙在逻辑文本中的起点。
+      char *characters;
+    };
+    char text[ROW_INLINE_CAPACITY];
+  };
+} erow;
+
+void rowInit(erow *row, const char *s, int len);
+
+void rowInitMapped(erow *row, const char *s, int len);
+
+void rowDetach(erow *row);
+
+void rowFree(erow *row);
+
+char rowCharAt(const erow *row, int at);
+
+int rowSpan(const erow *row, int index, const char **s);
+
+const char *rowText(erow *row);
+
+void rowInsert(erow *row, int at, const char *s, int len);
+
+void rowDelete(erow *row, int at, int len);
+
+
+#endif //ROW_H
@@ -0,0 +1,192 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "save.h"
+#include "terminal.h"
+
+
+#define SAVE_IOV_BATCH 512           // 每次 writev 提交的最多片段数。
+#define SAVE_STAGING (256 << 10)     // 短片段的暂存区大小。
+#define SAVE_DIRECT_MIN 4096         // 不短于此长度的片段直接从行存储写出。
+
+// 提交一批片段，处理 writev 的部分写入。
+static int saveWritevAll(int fd, struct iovec *iov, int count) {
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, count);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    // 跳过已完整写出的片段，并调整写了一半的片段。
+    while (count > 0 && (size_t) written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *) iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+  return 0;
+}
+
+// 流式写出器：短片段先拷进固定大小的暂存区，长片段直接引用行存储，
+// 攒满一批后用一次 writev 提交。整个保存过程只需常数大小的额外内存。
+struct saveWriter {
+  int fd;
+  struct iovec iov[SAVE_IOV_BATCH];
+  int count;
+  char staging[SAVE_STAGING];
+  int staged;
+  long long total;
+};
+
+static int saveWriterFlush(struct saveWriter *w) {
+  if (saveWritevAll(w->fd, w->iov, w->count) == -1)
+    return -1;
+  w->count = 0;
+  w->staged = 0;
+  return 0;
+}
+
+static int saveWriterAppend(struct saveWriter *w, const char *s, size_t len) {
+  if (len == 0)
+    return 0;
+  w->total += len;
+  if (len >= SAVE_DIRECT_MIN) {
+    if (w->count == SAVE_IOV_BATCH && saveWriterFlush(w) == -1)
+      return -1;
+    w->iov[w->count].iov_base = (char *) s;
+    w->iov[w->count].iov_len = len;
+    w->count++;
+    return 0;
+  }
+
+  if (w->staged + len > SAVE_STAGING && saveWriterFlush(w) == -1)
+    return -1;
+  char *dst = &w->staging[w->staged];
+  memcpy(dst, s, len);
+  w->staged += len;
+  // 紧接着上一段暂存内容时直接延长该片段。
+  struct iovec *last = w->count ? &w->iov[w->count - 1] : NULL;
+  if (last && (char *) last->iov_base + last->iov_len == dst) {
+    last->iov_len += len;
+    return 0;
+  }
+  if (w->count == SAVE_IOV_BATCH) {
+    // 片段已满：先提交，再把刚暂存的内容挪到暂存区开头。
+    w->staged -= len;
+    if (saveWriterFlush(w) == -1)
+      return -1;
+    w->total -= len;
+    return saveWriterAppend(w, s, len);
+  }
+  w->iov[w->count].iov_base = dst;
+  w->iov[w->count].iov_len = len;
+  w->count++;
+  return 0;
+}
+
+static int saveWriterRow(erow *row, void *arg) {
+  struct saveWriter *w = arg;
+  const char *s;
+  int len;
+  for (int k = 0; (len = rowSpan(row, k, &s)) != -1; k++)
+    if (saveWriterAppend(w, s, len) == -1)
+      return 1;
+  return saveWriterAppend(w, "\n", 1) == -1;
+}
+
+// 按顺序遍历行存储并流式写出所有行，返回写出的字节数，出错返回 -1。
+static long long saveWriteRows(const struct rowBuffer *rows, int fd) {
+  static struct saveWriter w;
+  w.fd = fd;
+  w.count = 0;
+  w.staged = 0;
+  w.total = 0;
+  if (bufferForEach(rows, saveWriterRow, &w) || saveWriterFlush(&w) == -1)
+    return -1;
+  return w.total;
+}
+
+// fsync path 所在的目录，使 rename 换上的目录项在崩溃后也能保留。
+static int syncParent(const char *path) {
+  const char *slash = strrchr(path, '/');
+  char *dir = slash ? strndup(path, slash == path ? 1 : (size_t) (slash - path)) : strdup(".");
+  if (dir == NULL) die("malloc");
+  int fd = open(dir, O_RDONLY | O_DIRECTORY);
+  free(dir);
+  if (fd == -1)
+    return -1;
+  int result = fsync(fd);
+  if (close(fd) == -1)
+    result = -1;
+  return result;
+}
+
+// 把 rows 保存到 filename：先写入同目录下的临时文件，再用 rename 原子替换。
+// sync 非零时在替换前 fsync 临时文件、替换后 fsync 所在目录。
+// 返回写出的字节数；出错返回 -1 并保留 errno，此时原文件保持不变，映射着旧文件的行也不受影响。
+// 替换后的文件是新的 inode：权限、属主和属组沿用原文件，但原文件的其他硬链接仍指向旧内容。
+long long saveFile(const struct rowBuffer *rows, const char *filename, int sync) {
+  // 符号链接保存到其指向的文件，而不是替换链接本身。
+  char *target = realpath(filename, NULL);
+  const char *path = target ? target : filename;
+
+  size_t tmplen = strlen(path) + sizeof(".texor-XXXXXX");
+  char *tmp = malloc(tmplen);
+  if (tmp == NULL) die("malloc");
+  snprintf(tmp, tmplen, "%s.texor-XXXXXX", path);
+
+  long long len = -1;
+  int fd = mkstemp(tmp);
+  if (fd != -1) {
+    // 沿用原文件的属主、属组和权限；新文件与以前一样按 0644 与 umask 创建。
+    struct stat st;
+    mode_t mode;
+    if (stat(path, &st) == 0) {
+      mode = st.st_mode & 07777;
+      if (fchown(fd, st.st_uid, st.st_gid) == -1) {
+        // 无权沿用别人的属主时至少保留属组，并去掉不再对应原属主、属组的 setuid、setgid 位。
+        mode &= ~(mode_t) S_ISUID;
+        if (fchown(fd, (uid_t) -1, st.st_gid) == -1)
+          mode &= ~(mode_t) S_ISGID;
+      }
+    } else {
+      mode_t mask = umask(0);
+      umask(mask);
+      mode = 0644 & ~mask;
+    }
+
+    if (fchmod(fd, mode) != -1)
+      len = saveWriteRows(rows, fd);
+    if (len != -1 && sync && fsync(fd) == -1)
+      len = -1;
+    if (close(fd) == -1)
+      len = -1;
+    if (len != -1 && rename(tmp, path) == -1)
+      len = -1;
+    if (len == -1) {
+      int saved_errno = errno;
+      unlink(tmp);
+      errno = saved_errno;
+    } else if (sync && syncParent(path) == -1) {
+      len = -1;
+    }
+  }
+
+  free(tmp);
+  free(target);
+  return len;
+}
@@ -0,0 +1,10 @@
+#ifndef SAVE_H
+#define SAVE_H
+
+#include "buffer.h"
+
+
+long long saveFile(const struct rowBuffer *rows, const char *filename, int sync);
+
+
+#endif //SAVE_H
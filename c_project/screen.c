@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "screen.h"
+#include "terminal.h"
+
+
+// 两段差异之间的未变单元格不超过此数目时合并为一段输出：
+// 重写这几个字节不比插入一个光标移动序列更长。
+#define SCREEN_MERGE_GAP 6
+
+struct screenLine {
+  char *cells;    // 本行内容，len 之后直到行尾视为空白。
+  int len;
+  int inverse;    // 整行反色显示（状态栏）。
+};
+
+// 双缓冲：frames[current] 为正在绘制的新帧，另一帧是终端上现有内容的影子。
+static struct screenLine *frames[2];
+static int current = 0;
+static int rows = 0;
+static int columns = 0;
+static int valid = 0;           // 影子帧是否与终端内容一致。
+static int term_y = -1;         // 终端光标位置，-1 表示未知。
+static int term_x = -1;
+
+static char *out = NULL;
+static int out_len = 0;
+static int out_capacity = 0;
+
+static void emit(const char *s, int len) {
+  if (out_len + len > out_capacity) {
+    int capacity = out_capacity ? out_capacity * 2 : 4096;
+    while (capacity < out_len + len) capacity *= 2;
+    char *buf = realloc(out, capacity);
+    if (buf == NULL) die("realloc");
+    out = buf;
+    out_capacity = capacity;
+  }
+  memcpy(&out[out_len], s, len);
+  out_len += len;
+}
+
+// 写出文本后光标右移；写到最后一列时终端处于待折行状态，位置视为未知。
+static void emitText(const char *s, int len) {
+  emit(s, len);
+  term_x += len;
+  if (term_x >= columns) term_y = term_x = -1;
+}
+
+// 选用最短的光标移动序列：同一行向右用相对移动，行首省略列号。
+static void emitMove(int y, int x) {
+  if (y == term_y && x == term_x) return;
+  char buf[32];
+  int len;
+  if (y == term_y && x > term_x)
+    len = snprintf(buf, sizeof(buf), "\x1b[%dC", x - term_x);
+  else if (x == 0)
+    len = snprintf(buf, sizeof(buf), "\x1b[%dH", y + 1);
+  else
+    len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1);
+  emit(buf, len);
+  term_y = y;
+  term_x = x;
+}
+
+static char cellAt(const struct screenLine *line, int x) {
+  return x < line->len ? line->cells[x] : ' ';
+}
+
+// 只含可打印 ASCII 的行才能按单元格比较：多字节字符与控制字符
+// 在终端上的宽度和字节数不一致，这样的行总是整行重绘。
+static int linePlain(const struct screenLine *line) {
+  for (int x = 0; x < line->len; x++) {
+    unsigned char c = line->cells[x];
+    if (c < 0x20 || c > 0x7e) return 0;
+  }
+  return 1;
+}
+
+static void drawLine(int y, const struct screenLine *line, int plain) {
+  emitMove(y, 0);
+  if (line->inverse) emit("\x1b[7m", 4);
+  emitText(line->cells, line->len);
+  if (line->inverse) emit("\x1b[m", 3);
+  if (line->len < columns) emit("\x1b[K", 3);
+  if (!plain) term_y = term_x = -1;
+}
+
+// 只输出与影子行不同的片段；新行变短时用清除到行尾代替写空格。
+static void diffLine(int y, const struct screenLine *shadow, const struct screenLine *line) {
+  int end = shadow->len > line->len ? shadow->len : line->len;
+  int opened = 0;
+  int x = 0;
+  while (x < end) {
+    if (cellAt(shadow, x) == cellAt(line, x)) {
+      x++;
+      continue;
+    }
+    int start = x;
+    int last = x;
+    for (x++; x < end && x - last <= SCREEN_MERGE_GAP; x++)
+      if (cellAt(shadow, x) != cellAt(line, x)) last = x;
+
+    emitMove(y, start);
+    if (line->inverse && !opened) {
+      emit("\x1b[7m", 4);
+      opened = 1;
+    }
+    if (last >= line->len) {
+      if (start < line->len) emitText(&line->cells[start], line->len - start);
+      if (opened) emit("\x1b[m", 3);
+      opened = 0;
+      emit("\x1b[K", 3);
+      break;
+    }
+    emitText(&line->cells[start], last + 1 - start);
+    x = last + 1;
+  }
+  if (opened) emit("\x1b[m", 3);
+}
+
+// 按新的屏幕尺寸重建两帧，下一次输出整屏重绘。
+void screenResize(int new_rows, int new_columns) {
+  for (int f = 0; f < 2; f++) {
+    for (int y = 0; y < rows; y++) free(frames[f][y].cells);
+    free(frames[f]);
+    frames[f] = calloc(new_rows ? new_rows : 1, sizeof(struct screenLine));
+    if (frames[f] == NULL) die("calloc");
+    for (int y = 0; y < new_rows; y++) {
+      frames[f][y].cells = malloc(new_columns ? new_columns : 1);
+      if (frames[f][y].cells == NULL) die("malloc");
+    }
+  }
+  rows = new_rows;
+  columns = new_columns;
+  screenInvalidate();
+}
+
+// 终端内容被其他途径改写后调用，丢弃影子帧。
+void screenInvalidate(void) {
+  valid = 0;
+  term_y = term_x = -1;
+}
+
+// 开始绘制新的一帧，所有行清空。
+void screenBegin(void) {
+  for (int y = 0; y < rows; y++) {
+    frames[current][y].len = 0;
+    frames[current][y].inverse = 0;
+  }
+}
+
+// 向第 y 行末尾追加内容，超出屏幕宽度的部分被截断。
+void screenPut(int y, const char *s, int len) {
+  struct screenLine *line = &frames[current][y];
+  if (len > columns - line->len) len = columns - line->len;
+  if (len <= 0) return;
+  memcpy(&line->cells[line->len], s, len);
+  line->len += len;
+}
+
+void screenSetInverse(int y) {
+  frames[current][y].inverse = 1;
+}
+
+// 比较新帧与影子帧，返回把终端更新到新帧所需的最少输出（可能为空），
+// 并把光标放到 (cursor_y, cursor_x)。返回的指针在下一次调用之前有效。
+const char *screenFlush(int cursor_y, int cursor_x, int *len) {
+  struct screenLine *lines = frames[current];
+  struct screenLine *shadow = frames[!current];
+  out_len = 0;
+  emit("\x1b[?25l", 6);
+
+  for (int y = 0; y < rows; y++) {
+    int plain = linePlain(&lines[y]);
+    if (valid && lines[y].inverse == shadow[y].inverse && plain && linePlain(&shadow[y])) {
+      diffLine(y, &shadow[y], &lines[y]);
+    } else if (!valid || lines[y].len != shadow[y].len || lines[y].inverse != shadow[y].inverse ||
+               memcmp(lines[y].cells, shadow[y].cells, lines[y].len) != 0) {
+      drawLine(y, &lines[y], plain);
+    }
+  }
+
+  // 内容没有变化时不必隐藏光标，只在需要时移动它。
+  int changed = out_len > 6;
+  if (!changed) out_len = 0;
+  emitMove(cursor_y, cursor_x);
+  if (changed) emit("\x1b[?25h", 6);
+
+  valid = 1;
+  current = !current;
+  *len = out_len;
+  return out;
+}
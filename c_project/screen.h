@@ -0,0 +1,18 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+
+void screenResize(int rows, int columns);
+
+void screenInvalidate(void);
+
+void screenBegin(void);
+
+void screenPut(int y, const char *s, int len);
+
+void screenSetInverse(int y);
+
+const char *screenFlush(int cursor_y, int cursor_x, int *len);
+
+
+#endif //SCREEN_H
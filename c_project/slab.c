@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+#include "terminal.h"
+
+
+// 行存储专用的分级分配器。小块按大小分为 16、24、32、48、64……4096 共 17 级，
+// 相邻两级相差不超过一半，从 64 KiB 的大页中顺序切出，释放后挂到本级的空闲链表上复用。
+// 块本身不带头部：调用者释放时提供申请时的大小（行的容量、固定的节点大小）。
+// 超过最大级别（SLAB_MAX_SIZE）的块直接交给 malloc。只在主线程使用，不加锁。
+// 所有大页串成链表，关闭文件时可用 slabReleaseAll 一次性整体归还。
+#define SLAB_MIN_SIZE 16
+#define SLAB_CLASSES 17
+#define SLAB_PAGE_SIZE (64 << 10)
+
+struct slabBlock {
+  struct slabBlock *next;
+};
+
+struct slabPage {
+  struct slabPage *next;
+};
+
+static struct slabBlock *free_lists[SLAB_CLASSES];
+static struct slabPage *pages = NULL; // 已分配的全部大页。
+static char *page = NULL;         // 当前大页中尚未切出的部分。
+static size_t page_left = 0;
+
+// 返回能容纳 size 字节的最小级别：2^b 或 3 * 2^(b-2)。
+static int classOf(size_t size) {
+  if (size <= SLAB_MIN_SIZE) return 0;
+  int b = 0;
+  while (((size_t) 1 << b) < size) b++;
+  if (size <= (size_t) 3 << (b - 2)) return 2 * (b - 4) - 1;
+  return 2 * (b - 4);
+}
+
+static size_t classSize(int c) {
+  return (c & 1) ? (size_t) 3 << (c / 2 + 3) : (size_t) SLAB_MIN_SIZE << (c / 2);
+}
+
+// 实际分得的块大小。调用者可以把多出的部分当作容量使用，释放时按此大小归还即可。
+size_t slabSize(size_t size) {
+  return size > SLAB_MAX_SIZE ? size : classSize(classOf(size));
+}
+
+void *slabAlloc(size_t size) {
+  if (size > SLAB_MAX_SIZE) {
+    void *p = malloc(size);
+    if (p == NULL) die("malloc");
+    return p;
+  }
+
+  int c = classOf(size);
+  struct slabBlock *block = free_lists[c];
+  if (block) {
+    free_lists[c] = block->next;
+    return block;
+  }
+
+  size_t bytes = classSize(c);
+  if (page_left < bytes) {
+    // 旧页剩下的零头按从大到小切给各级空闲链表，不浪费。
+    for (int k = SLAB_CLASSES - 1; k >= 0; k--) {
+      while (page_left >= classSize(k)) {
+        block = (struct slabBlock *) page;
+        block->next = free_lists[k];
+        free_lists[k] = block;
+        page += classSize(k);
+        page_left -= classSize(k);
+      }
+    }
+    struct slabPage *fresh = malloc(SLAB_PAGE_SIZE);
+    if (fresh == NULL) die("malloc");
+    fresh->next = pages;
+    pages = fresh;
+    page = (char *) (fresh + 1);
+    page_left = SLAB_PAGE_SIZE - sizeof(struct slabPage);
+  }
+  void *p = page;
+  page += bytes;
+  page_left -= bytes;
+  return p;
+}
+
+void slabFree(void *p, size_t size) {
+  if (p == NULL) return;
+  if (size > SLAB_MAX_SIZE) {
+    free(p);
+    return;
+  }
+  int c = classOf(size);
+  struct slabBlock *block = p;
+  block->next = free_lists[c];
+  free_lists[c] = block;
+}
+
+// 调整块的大小。新旧大小落在同一级别时原地返回，否则搬到新块。
+void *slabRealloc(void *p, size_t old_size, size_t new_size) {
+  if (p == NULL) return slabAlloc(new_size);
+  if (old_size > SLAB_MAX_SIZE && new_size > SLAB_MAX_SIZE) {
+    p = realloc(p, new_size);
+    if (p == NULL) die("realloc");
+    return p;
+  }
+  if (slabSize(old_size) == slabSize(new_size)) return p;
+
+  void *q = slabAlloc(new_size);
+  memcpy(q, p, old_size < new_size ? old_size : new_size);
+  slabFree(p, old_size);
+  return q;
+}
+
+// 整体归还所有大页，此前分出的小块全部失效，无需逐个 slabFree。
+// 大于 SLAB_MAX_SIZE 的块不在大页中，仍需调用者逐个 slabFree。
+void slabReleaseAll(void) {
+  while (pages) {
+    struct slabPage *next = pages->next;
+    free(pages);
+    pages = next;
+  }
+  memset(free_lists, 0, sizeof(free_lists));
+  page = NULL;
+  page_left = 0;
+}
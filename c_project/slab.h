@@ -0,0 +1,21 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+
+// 不超过此大小的块从大页中分出，更大的块单独 malloc。
+#define SLAB_MAX_SIZE 4096
+
+void *slabAlloc(size_t size);
+
+void slabFree(void *p, size_t size);
+
+void *slabRealloc(void *p, size_t old_size, size_t new_size);
+
+size_t slabSize(size_t size);
+
+void slabReleaseAll(void);
+
+
+#endif //SLAB_H
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <termios.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -17,7 +18,9 @@ void die(const char *s) {
 }
 
 void disableRawMode(void) {
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios_static) == -1)
+    write(STDOUT_FILENO, "\x1b[?2004l", 8);
+    // 终端已挂断时无从恢复，也无处报告。
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios_static) == -1 && errno != EIO)
         die("tcsetattr");
 }
 
@@ -31,8 +34,12 @@ void enableRawMode(void) {
     raw.c_oflag &= ~(OPOST);
     raw.c_cflag |= (CS8);
     raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    // read 不再定时返回：何时读取由主循环的 poll 决定。
     raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;
+    raw.c_cc[VTIME] = 0;
 
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) die("tcsetattr");
+
+    // 开启括号粘贴：粘贴的内容被 ESC[200~ 与 ESC[201~ 包围，整体作为一次输入处理。
+    write(STDOUT_FILENO, "\x1b[?2004h", 8);
 }
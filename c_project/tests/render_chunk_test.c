@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "render.h"
+#include "row.h"
+
+
+// 长行分块模糊测试。render.c 以很小的 RENDER_LONG_ROW 与 RENDER_CHUNK 编译，
+// 使几百字节的行就按块渲染，每次编辑都会重新切分块并平移其后各块的列。
+// 对随机的插入、删除（含制表符，可跨越多块）和间隙移动，每次 renderEdit 之后
+// 比较 renderColumn 与各个视口的 renderRow 和逐字节展开的结果。
+// 行长在阈值上下浮动，覆盖编辑后跨过阈值时退回整行失效的路径。
+#define TEST_ROUNDS 100
+#define TEST_EDITS 200
+#define TEST_MAX_LEN 3000
+
+static unsigned int seed = 25;
+
+static int randomInt(int n) {
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % n;
+}
+
+static char randomChar(int tab_every) {
+  return randomInt(tab_every) == 0 ? '\t' : 'a' + randomInt(26);
+}
+
+// 逐字节展开整行，columns[j] 记下文件位置 j 处的屏幕列，返回展开后的宽度。
+static int expand(const erow *row, char *out, int *columns) {
+  int n = 0;
+  for (int j = 0; j < row->size; j++) {
+    columns[j] = n;
+    char c = rowCharAt(row, j);
+    if (c == '\t') {
+      do out[n++] = ' '; while (n % TEXOR_TAB_STOP != 0);
+    } else {
+      out[n++] = c;
+    }
+  }
+  columns[row->size] = n;
+  return n;
+}
+
+// 与逐字节展开的结果比较，返回不一致的个数。
+static int check(erow *row) {
+  static char expected[(TEST_MAX_LEN + 256) * TEXOR_TAB_STOP];
+  static int columns[TEST_MAX_LEN + 257];
+  int size = expand(row, expected, columns);
+
+  for (int file_x = 0; file_x <= row->size; file_x++) {
+    int got = renderColumn(row, file_x);
+    if (got != columns[file_x]) {
+      printf("column mismatch: size %d file_x %d got %d want %d\n", row->size, file_x, got, columns[file_x]);
+      return 1;
+    }
+  }
+
+  for (int k = 0; k < 8; k++) {
+    int column = k == 0 ? 0 : randomInt(size + 16);
+    int width = k == 0 ? size + 16 : 1 + randomInt(k < 4 ? 80 : 400);
+    int want = size - column;
+    if (want < 0) want = 0;
+    if (want > width) want = width;
+    int len;
+    const char *got = renderRow(row, column, width, &len);
+    if (len != want || memcmp(got, &expected[column < size ? column : size], len) != 0) {
+      printf("window mismatch: size %d column %d width %d len %d want %d\n", row->size, column, width, len, want);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(void) {
+  static char line[TEST_MAX_LEN];
+  long edits = 0;
+  int failures = 0;
+
+  for (int round = 0; round < TEST_ROUNDS && failures == 0; round++) {
+    int len = randomInt(TEST_MAX_LEN);
+    // 0 表示整行没有制表符，其后各块只整体平移。
+    int tab_every = randomInt(4) == 0 ? 0 : 1 + randomInt(40);
+    for (int j = 0; j < len; j++)
+      line[j] = tab_every ? randomChar(tab_every) : 'a' + randomInt(26);
+
+    erow row;
+    rowInit(&row, line, len);
+    failures += check(&row);
+
+    for (int edit = 0; edit < TEST_EDITS && failures == 0; edit++) {
+      int at = randomInt(row.size + 1);
+      // 多数编辑只有几个字节，偶尔跨越多块。
+      int n = 1 + (randomInt(8) == 0 ? randomInt(200) : randomInt(4));
+      int kind = randomInt(5);
+      if (kind == 0) {
+        // 只移动间隙，内容与缓存不变。
+        if (row.size > 0) rowDelete(&row, randomInt(row.size), 0);
+      } else if ((kind <= 2 || row.size == 0) && row.size + n <= TEST_MAX_LEN + 200) {
+        char s[200];
+        for (int j = 0; j < n; j++)
+          s[j] = tab_every ? randomChar(tab_every) : 'a' + randomInt(26);
+        rowInsert(&row, at, s, n);
+        renderEdit(&row, at, 0, n);
+      } else if (row.size > 0) {
+        if (at == row.size) at--;
+        if (n > row.size - at) n = row.size - at;
+        rowDelete(&row, at, n);
+        renderEdit(&row, at, n, 0);
+      }
+      failures += check(&row);
+      edits++;
+    }
+
+    renderInvalidate(&row);
+    rowFree(&row);
+  }
+
+  if (failures) {
+    printf("render_chunk_test: %d failures\n", failures);
+    return 1;
+  }
+  printf("render_chunk_test: ok, %ld edits\n", edits);
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+
+#include "render.h"
+#include "row.h"
+
+
+// 列坐标换算模糊测试：随机生成含不同密度制表符的行，并做随机插入、删除，
+// 对每个文件位置比较 renderColumn 在制表符表中二分查找的结果与从行首逐字节累加的结果。
+// 超出行尾的位置须截到行尾。
+#define TEST_ROUNDS 20000
+#define TEST_MAX_LEN 800
+
+static unsigned int seed = 7;
+
+static int randomInt(int n) {
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % n;
+}
+
+// 旧的换算方式：在屏幕列 column 之后再走过文件位置 file_x 处的一个字符。
+static int walkColumn(const erow *row, int file_x, int column) {
+  if (rowCharAt(row, file_x) == '\t') column += (TEXOR_TAB_STOP - 1) - (column % TEXOR_TAB_STOP);
+  return column + 1;
+}
+
+static char randomChar(int tab_every) {
+  return randomInt(tab_every) == 0 ? '\t' : 'a' + randomInt(26);
+}
+
+int main(void) {
+  static char line[TEST_MAX_LEN];
+  long checks = 0;
+  int failures = 0;
+
+  for (int round = 0; round < TEST_ROUNDS && failures == 0; round++) {
+    int len = randomInt(TEST_MAX_LEN);
+    int tab_every = 1 + randomInt(16);
+    for (int j = 0; j < len; j++)
+      line[j] = randomChar(tab_every);
+
+    erow row;
+    rowInit(&row, line, len);
+    for (int edit = 0; edit < 4 && failures == 0; edit++) {
+      int want = 0;
+      for (int file_x = 0; file_x <= row.size + 2; file_x++) {
+        if (file_x > 0 && file_x <= row.size) want = walkColumn(&row, file_x - 1, want);
+        int got = renderColumn(&row, file_x);
+        if (got != want) {
+          printf("mismatch: size %d file_x %d got %d want %d\n", row.size, file_x, got, want);
+          failures++;
+          break;
+        }
+        checks++;
+      }
+
+      // 修改后须重新换算：插入一段随机文本或删除若干字节。
+      int at = randomInt(row.size + 1);
+      if (randomInt(2) || row.size == 0) {
+        char s[8];
+        int n = 1 + randomInt(sizeof(s));
+        for (int j = 0; j < n; j++)
+          s[j] = randomChar(tab_every);
+        rowInsert(&row, at, s, n);
+        renderEdit(&row, at, 0, n);
+      } else {
+        if (at == row.size) at--;
+        int n = 1 + randomInt(8);
+        if (n > row.size - at) n = row.size - at;
+        rowDelete(&row, at, n);
+        renderEdit(&row, at, n, 0);
+      }
+    }
+
+    renderInvalidate(&row);
+    rowFree(&row);
+  }
+
+  if (failures) {
+    printf("render_column_test: %d failures\n", failures);
+    return 1;
+  }
+  printf("render_column_test: ok, %ld checks\n", checks);
+  return 0;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "render.h"
+#include "row.h"
+
+
+// 屏幕等价检查：对映射行、内联行和间隙在行首、行中、行尾的堆上行，
+// 不论有无制表符，renderRow 返回的各个视口都须与逐字节展开的结果逐字节相同。
+// 没有制表符且文本连续的行直接返回行本身的文本；渲染后间隙被移开时须改为复制。
+#define TEST_ROUNDS 20000
+#define TEST_MAX_LEN 300
+
+static unsigned int seed = 1;
+
+static int randomInt(int n) {
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % n;
+}
+
+// 逐字节展开制表符，返回展开后的宽度。
+static int expand(const char *s, int len, char *out) {
+  int n = 0;
+  for (int j = 0; j < len; j++) {
+    if (s[j] == '\t') {
+      do out[n++] = ' '; while (n % TEXOR_TAB_STOP != 0);
+    } else {
+      out[n++] = s[j];
+    }
+  }
+  return n;
+}
+
+// 比较行在若干视口下的渲染结果与 expected，返回不一致的个数。
+static int compareWindows(erow *row, const char *expected, int size) {
+  int failures = 0;
+  for (int k = 0; k < 4; k++) {
+    int column = k == 0 ? 0 : randomInt(size + 8);
+    int width = k == 0 ? size + 8 : 1 + randomInt(80);
+    int want = size - column;
+    if (want < 0) want = 0;
+    if (want > width) want = width;
+    int len;
+    const char *got = renderRow(row, column, width, &len);
+    if (len != want || memcmp(got, &expected[column < size ? column : size], len) != 0) {
+      printf("mismatch: size %d column %d width %d len %d want %d\n", size, column, width, len, want);
+      failures++;
+    }
+  }
+  return failures;
+}
+
+int main(void) {
+  static char line[TEST_MAX_LEN];
+  static char expected[TEST_MAX_LEN * TEXOR_TAB_STOP];
+  int failures = 0;
+
+  for (int round = 0; round < TEST_ROUNDS && failures == 0; round++) {
+    int len = randomInt(TEST_MAX_LEN);
+    // 约一半的行不含制表符，以覆盖直接返回行文本的路径。
+    int tab_every = randomInt(2) ? 0 : 1 + randomInt(12);
+    for (int j = 0; j < len; j++)
+      line[j] = tab_every && randomInt(tab_every) == 0 ? '\t' : 'a' + randomInt(26);
+    int size = expand(line, len, expected);
+
+    erow row;
+    int storage = randomInt(3);
+    if (storage == 0)
+      rowInitMapped(&row, line, len);
+    else
+      rowInit(&row, line, len);
+    if (storage == 2 && len > 0) {
+      // 不改变内容，只把间隙移到行中某处。
+      rowDelete(&row, randomInt(len), 0);
+    }
+    failures += compareWindows(&row, expected, size);
+
+    // 已渲染的行随后间隙被移开（内容不变、缓存仍然有效），结果须保持不变。
+    if (row.storage == ROW_HEAP && len > 0) {
+      rowDelete(&row, randomInt(len), 0);
+      failures += compareWindows(&row, expected, size);
+      rowText(&row);
+      failures += compareWindows(&row, expected, size);
+    }
+
+    renderInvalidate(&row);
+    rowFree(&row);
+  }
+
+  if (failures) {
+    printf("render_direct_test: %d failures\n", failures);
+    return 1;
+  }
+  printf("render_direct_test: ok\n");
+  return 0;
+}
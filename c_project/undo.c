@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "terminal.h"
+#include "undo.h"
+
+
+#define UNDO_MIN_ARENA (64 << 10)
+
+// 记录连同文本按头部的对齐取整，保证下一条记录的头部对齐。
+static size_t recordSize(size_t len) {
+  size_t align = _Alignof(struct undoRecord);
+  return (sizeof(struct undoRecord) + len + align - 1) & ~(align - 1);
+}
+
+static struct undoRecord *recordAt(const struct undoLog *log, size_t offset) {
+  return (struct undoRecord *) &log->arena[offset];
+}
+
+static int isText(int type) {
+  return type == UNDO_INSERT_TEXT || type == UNDO_DELETE_TEXT;
+}
+
+// 保证内存区至少有 size 字节，按倍增扩大但不超过上限。
+static void reserve(struct undoLog *log, size_t size) {
+  if (size <= log->capacity) return;
+  size_t capacity = log->capacity ? log->capacity * 2 : UNDO_MIN_ARENA;
+  while (capacity < size) capacity *= 2;
+  if (capacity > log->limit) capacity = log->limit;
+  char *arena = realloc(log->arena, capacity);
+  if (arena == NULL) die("realloc");
+  log->arena = arena;
+  log->capacity = capacity;
+}
+
+// 从最早的步骤开始整步淘汰，为 need 字节的新记录腾出空间。
+// 一次多淘汰约四分之一的上限，使搬移的开销均摊到多次写入上。
+// 当前步骤本身不能淘汰，放不下时返回 0。
+static int evict(struct undoLog *log, size_t need) {
+  size_t bound = log->opened ? log->step : log->used;
+  size_t minimum = log->used + need - log->limit;
+  size_t wanted = minimum + log->limit / 4;
+  size_t cut = 0;
+  size_t offset = 0;
+  while (offset < bound) {
+    offset += recordSize(recordAt(log, offset)->len);
+    if (offset >= bound || recordAt(log, offset)->step) {
+      cut = offset;
+      if (cut >= wanted) break;
+    }
+  }
+  if (cut < minimum) return 0;
+
+  memmove(log->arena, &log->arena[cut], log->used - cut);
+  log->used -= cut;
+  log->current -= cut;
+  log->last = log->current ? log->last - cut : 0;
+  if (log->opened) log->step -= cut;
+  if (log->used > 0) recordAt(log, 0)->prev = 0;
+  return 1;
+}
+
+// 单字符的输入或删除紧接在上一次同类修改之后时，直接扩展上一条记录：
+// 输入接在末尾，退格在开头补上被删的字符，向后删除接在末尾。
+static char *coalesce(struct undoLog *log, int type, int y, int x) {
+  if (!log->typing || log->current != log->used || log->current == 0) return NULL;
+  struct undoRecord *r = recordAt(log, log->last);
+  if (r->type != type || r->y != y || !isText(type)) return NULL;
+
+  int prepend;
+  if (type == UNDO_INSERT_TEXT && x == r->x + (int) r->len)
+    prepend = 0;
+  else if (type == UNDO_DELETE_TEXT && x == r->x)
+    prepend = 0;
+  else if (type == UNDO_DELETE_TEXT && x == r->x - 1)
+    prepend = 1;
+  else
+    return NULL;
+
+  size_t size = recordSize(r->len + 1);
+  if (log->last + size > log->limit) return NULL;
+  reserve(log, log->last + size);
+  r = recordAt(log, log->last);
+  char *text = (char *) (r + 1);
+  if (prepend) {
+    memmove(text + 1, text, r->len);
+    r->x--;
+  }
+  r->len++;
+  log->used = log->current = log->last + size;
+  // 续写上一步骤，撤销时一并撤销；其结束光标由 undoEnd 更新。
+  log->opened = 1;
+  return prepend ? text : &text[r->len - 1];
+}
+
+void undoInit(struct undoLog *log, size_t limit) {
+  log->arena = NULL;
+  log->capacity = 0;
+  log->limit = limit;
+  log->recording = 0;
+  undoClear(log);
+}
+
+// 丢弃全部历史，内存区保留以便复用。
+void undoClear(struct undoLog *log) {
+  log->used = 0;
+  log->current = 0;
+  log->last = 0;
+  log->step = 0;
+  log->opened = 0;
+  log->typing = 0;
+  log->discarding = 0;
+}
+
+// 一次编辑开始：其间写入的记录构成一个撤销步骤。
+void undoBegin(struct undoLog *log, int cursor_y, int cursor_x) {
+  log->recording = 1;
+  log->opened = 0;
+  log->plain = 1;
+  log->discarding = 0;
+  log->before_y = cursor_y;
+  log->before_x = cursor_x;
+}
+
+// 记下一次修改，返回供调用者填入 len 字节文本的位置。
+// typed 非零表示这是一次键入或删除单个字符，只有这样的记录才会与相邻的同类修改合并；
+// 行的拼接等其他修改即使只涉及一个字节也总是开始新的记录。
+// 不在编辑中或当前步骤已被放弃时返回 NULL。
+char *undoRecord(struct undoLog *log, int type, int y, int x, int count, size_t len, int typed) {
+  if (!log->recording || log->discarding) return NULL;
+  if (!(typed && isText(type) && len == 1) && !(type == UNDO_INSERT_ROWS && len == 0))
+    log->plain = 0;
+  if (typed && !log->opened && len == 1) {
+    char *text = coalesce(log, type, y, x);
+    if (text) return text;
+  }
+
+  // 新的修改使可重做的记录作废。
+  log->used = log->current;
+  size_t need = recordSize(len);
+  if (log->used + need > log->limit && !evict(log, need)) {
+    // 单个步骤超过上限：无法撤销它，也就无法越过它撤销更早的修改。
+    undoClear(log);
+    log->discarding = 1;
+    return NULL;
+  }
+  reserve(log, log->used + need);
+
+  struct undoRecord *r = recordAt(log, log->used);
+  r->type = type;
+  r->step = !log->opened;
+  r->y = y;
+  r->x = x;
+  r->count = count;
+  r->len = len;
+  r->prev = log->current ? log->current - log->last : 0;
+  if (!log->opened) {
+    log->opened = 1;
+    log->step = log->used;
+    r->before_y = log->before_y;
+    r->before_x = log->before_x;
+  }
+  log->last = log->used;
+  log->used += need;
+  log->current = log->used;
+  return (char *) (r + 1);
+}
+
+// 一次编辑结束。返回非零表示这一步骤因超出内存上限而没有记录，历史已被清空。
+int undoEnd(struct undoLog *log, int cursor_y, int cursor_x) {
+  int discarded = log->discarding;
+  if (log->opened) {
+    struct undoRecord *r = recordAt(log, log->step);
+    r->after_y = cursor_y;
+    r->after_x = cursor_x;
+    log->typing = log->plain && isText(recordAt(log, log->last)->type);
+  }
+  log->recording = 0;
+  log->opened = 0;
+  log->discarding = 0;
+  return discarded;
+}
+
+// 撤销位置后退一条，返回被越过的记录；已无可撤销的记录时返回 NULL。
+// 调用者逐条反向应用，直到返回的记录是步骤的第一条。
+const struct undoRecord *undoBack(struct undoLog *log) {
+  if (log->current == 0) return NULL;
+  struct undoRecord *r = recordAt(log, log->last);
+  log->current = log->last;
+  log->last -= r->prev;
+  log->typing = 0;
+  return r;
+}
+
+// 撤销位置前进一条，返回被越过的记录；没有可重做的记录，
+// 或 within_step 非零且下一条记录属于下一步骤时返回 NULL。
+const struct undoRecord *undoForward(struct undoLog *log, int within_step) {
+  if (log->current == log->used) return NULL;
+  struct undoRecord *r = recordAt(log, log->current);
+  if (within_step && r->step) return NULL;
+  log->last = log->current;
+  log->current += recordSize(r->len);
+  log->typing = 0;
+  return r;
+}
+
+const char *undoText(const struct undoRecord *r) {
+  return (const char *) (r + 1);
+}
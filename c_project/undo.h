@@ -0,0 +1,62 @@
+#ifndef UNDO_H
+#define UNDO_H
+
+#include <stddef.h>
+
+
+enum undoType {
+  UNDO_INSERT_TEXT = 1,   // 在第 y 行第 x 列插入了文本。
+  UNDO_DELETE_TEXT,       // 从第 y 行第 x 列删除了文本。
+  UNDO_INSERT_ROWS,       // 在第 y 行处插入了 count 行，文本为以 '\n' 分隔的各行内容。
+  UNDO_DELETE_ROW         // 删除了第 y 行，文本为其内容。
+};
+
+// 日志中的一条记录，其后紧跟 len 字节的文本。
+struct undoRecord {
+  int type;               // enum undoType
+  int step;               // 非零表示此记录是一个撤销步骤的第一条。
+  int y, x;
+  int count;
+  int before_y, before_x; // 步骤开始前与结束后的光标，仅在步骤的第一条记录中有效。
+  int after_y, after_x;
+  size_t len;
+  size_t prev;            // 与前一条记录的距离，0 表示日志中的第一条。
+};
+
+// 撤销日志：操作记录依次存放在一块连续的内存区中，只记录差异而非快照。
+// [0, current) 为已生效的记录，[current, used) 为撤销后可重做的记录。
+// 内存区按需倍增，总量不超过 limit；写满时从最早的步骤开始整步淘汰。
+struct undoLog {
+  char *arena;
+  size_t capacity;
+  size_t limit;
+  size_t used;
+  size_t current;
+  size_t last;            // current 之前最后一条记录的偏移。
+  size_t step;            // 当前（或刚结束的）步骤第一条记录的偏移。
+  int before_y, before_x;
+  int recording;          // 位于 undoBegin 与 undoEnd 之间。
+  int opened;             // 当前步骤已写入记录。
+  int plain;              // 当前步骤只含单字符的输入或删除。
+  int typing;             // 上一步骤是连续输入，下一次单字符修改可以并入其中。
+  int discarding;         // 当前步骤超出内存上限，已被放弃。
+};
+
+void undoInit(struct undoLog *log, size_t limit);
+
+void undoClear(struct undoLog *log);
+
+void undoBegin(struct undoLog *log, int cursor_y, int cursor_x);
+
+char *undoRecord(struct undoLog *log, int type, int y, int x, int count, size_t len, int typed);
+
+int undoEnd(struct undoLog *log, int cursor_y, int cursor_x);
+
+const struct undoRecord *undoBack(struct undoLog *log);
+
+const struct undoRecord *undoForward(struct undoLog *log, int within_step);
+
+const char *undoText(const struct undoRecord *r);
+
+
+#endif //UNDO_H